@@ -0,0 +1,123 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "bmp_l1.h"
+
+#define LABEL_COUNT   20000
+#define LABEL_WIDTH   384   // 48mm at 203dpi
+#define LABEL_HEIGHT  192
+
+// Microseconds each label waits on top of drawing, 0: none. See main()
+static long label_wait_us;
+
+// Render one shipping-label-like image
+static int render_label(void *ctx, uint8_t *pbmp)
+{
+  uint32_t id = (uint32_t)(uintptr_t)ctx;
+  char text[32];
+
+  BMP_L1_fill(pbmp, BMP_L1_WHITE);
+  BMP_L1_drawRect(pbmp, 0, 0, LABEL_WIDTH - 1, 3, BMP_L1_BLACK);
+  BMP_L1_drawRect(pbmp, 0, LABEL_HEIGHT - 4, LABEL_WIDTH - 1, LABEL_HEIGHT - 1, BMP_L1_BLACK);
+
+  snprintf(text, sizeof(text), "ORDER %08u", (unsigned)id);
+  BMP_L1_drawText(pbmp, text, BMP_L1_FONT_6X10, 10, 12, BMP_L1_BLACK);
+  BMP_L1_drawText(pbmp, "SHIP TO: 1-2-3 EXAMPLE ST.", BMP_L1_FONT_6X10, 10, 28, BMP_L1_BLACK);
+  BMP_L1_drawText(pbmp, "QTY 1   WEIGHT 0.5KG", BMP_L1_FONT_6X10, 10, 44, BMP_L1_BLACK);
+
+  // Barcode-like bars
+  for (uint32_t i = 0, x = 10; i < 48 && x < LABEL_WIDTH - 10; i++) {
+    uint32_t w = 1 + ((id >> (i % 24)) & 0x03);
+    BMP_L1_drawRect(pbmp, x, 70, x + w - 1, 170, BMP_L1_BLACK);
+    x += w + 2;
+  }
+  BMP_L1_drawLine(pbmp, 0, 180, LABEL_WIDTH - 1, 180, BMP_L1_BLACK);
+
+  // Uneven job lengths (0.5x to 2x), so results often finish out of order
+  if (label_wait_us > 0) {
+    long us = label_wait_us / 2 + (long)((id * 2654435761u) >> 16) % (label_wait_us * 3 / 2 + 1);
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+  }
+  return 0;
+}
+
+// Consume results in order (stands in for writing them to a spool)
+static int consume_label(void *ctx, uint32_t index, uint8_t *pbmp)
+{
+  uint32_t *checksum = (uint32_t *)ctx;
+  if (pbmp == NULL)
+    return -1;
+  *checksum = (*checksum * 31) + index + pbmp[BMP_L1_getOffset(pbmp) + 1000];
+  return 0;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+  BMP_L1_job_st *jobs;
+  BMP_L1_batch_st batch = {0};
+  uint32_t checksum, checksum_ref = 0;
+  uint32_t cores = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t count = LABEL_COUNT;
+  double base = 0.0;
+
+  // Optional arguments: maximum number of threads (default: number of cores), and a wait in
+  // microseconds added to every label. Waiting jobs overlap even on one core, so the wait run
+  // shows whether the in-order hand-out holds workers back, independently of the core count.
+  if (argc > 1 && atoi(argv[1]) > 0)
+    cores = (uint32_t)atoi(argv[1]);
+  if (argc > 2 && atol(argv[2]) > 0) {
+    label_wait_us = atol(argv[2]);
+    count = LABEL_COUNT / 10;
+  }
+
+  jobs = malloc(sizeof(BMP_L1_job_st) * count);
+  if (jobs == NULL) {
+    printf("Failed to allocate jobs\n");
+    return -1;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    jobs[i].render = render_label;
+    jobs[i].ctx    = (void *)(uintptr_t)i;
+    jobs[i].width  = LABEL_WIDTH;
+    jobs[i].height = LABEL_HEIGHT;
+  }
+
+  printf("%u labels of %ux%u, up to %u threads, %ld us wait per label\n", count, LABEL_WIDTH, LABEL_HEIGHT, cores, label_wait_us);
+  printf("threads  labels/s  speedup\n");
+  for (uint32_t threads = 1; threads <= cores; threads = (threads * 2 > cores && threads < cores) ? cores : threads * 2) {
+    checksum = 0;
+    batch.threads = threads;
+    batch.result  = consume_label;
+    batch.ctx     = &checksum;
+
+    double t0 = now();
+    if (BMP_L1_renderBatch(jobs, count, &batch) != 0) {
+      printf("Failed to render batch\n");
+      return -1;
+    }
+    double rate = count / (now() - t0);
+
+    // Results arrive in submission order, so the checksum must not depend on the thread count
+    if (threads == 1) {
+      base = rate;
+      checksum_ref = checksum;
+    } else if (checksum != checksum_ref) {
+      printf("Result order mismatch\n");
+      return -1;
+    }
+    printf("%7u  %8.0f  %6.2fx\n", threads, rate, rate / base);
+  }
+
+  free(jobs);
+  return 0;
+}
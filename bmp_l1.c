@@ -5,6 +5,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#ifdef BMP_L1_USE_PTHREAD
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
 
 /* Include user header files -------------------------------------------------*/
 #include "bmp_l1.h"
@@ -22,14 +26,208 @@
 #define BMP_L1_FILE_HEADER_SIZE	14	// = 0x0E
 #define BMP_L1_INFO_HEADER_SIZE	40	// = 0x28
 #define BMP_L1_PALETTE_SIZE	    (2*4)
+#define BMP_L1_WARP_AREA_N      4       // BMP_L1_WARP_AREA takes N x N samples per pixel
+#define BMP_L1_FIXED(v)         ((int64_t)((v) * 65536.0 + ((v) < 0 ? -0.5 : 0.5)))  // to 16.16 fixed point, rounded without libm
+
 static const uint32_t AllHeaderOffset = BMP_L1_FILE_HEADER_SIZE + BMP_L1_INFO_HEADER_SIZE + BMP_L1_PALETTE_SIZE;
 
+#ifndef BMP_L1_THREAD_LOCAL
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+#define BMP_L1_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define BMP_L1_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define BMP_L1_THREAD_LOCAL __declspec(thread)
+#elif defined(BMP_L1_ENABLE_STATS) || defined(BMP_L1_USE_PTHREAD)
+#error "BMP_L1_ENABLE_STATS and BMP_L1_USE_PTHREAD need thread-local storage: define BMP_L1_THREAD_LOCAL for this compiler"
+#else
+#define BMP_L1_THREAD_LOCAL
+#endif
+#endif
+
+// Hot-path statistics. Every macro expands to nothing unless BMP_L1_ENABLE_STATS is defined;
+// arguments of BMP_L1_STATS_END are then not evaluated.
+// Each API calls BMP_L1_STATS_BEGIN once its arguments are checked and before it allocates,
+// so timings include its own allocations.
+#ifdef BMP_L1_ENABLE_STATS
+#ifndef BMP_L1_STATS_CLOCK_TYPE
+#define BMP_L1_STATS_CLOCK_TYPE uint64_t
+#endif
+#ifdef BMP_L1_STATS_CLOCK
+#define BMP_L1_STATS_BEGIN()            BMP_L1_STATS_CLOCK_TYPE bmp_l1_stats_t0 = (BMP_L1_STATS_CLOCK_TYPE)BMP_L1_STATS_CLOCK()
+#define BMP_L1_STATS_TICKS()            ((BMP_L1_STATS_CLOCK_TYPE)((BMP_L1_STATS_CLOCK_TYPE)BMP_L1_STATS_CLOCK() - bmp_l1_stats_t0))
+#else
+#define BMP_L1_STATS_BEGIN()            ((void)0)
+#define BMP_L1_STATS_TICKS()            0
+#endif
+#define BMP_L1_STATS_END(api, px, by)   BMP_L1_stats_add((api), (uint64_t)(px), (uint64_t)(by), (uint64_t)BMP_L1_STATS_TICKS())
+#define BMP_L1_STATS_ALLOC(size)        do { bmp_l1_stats.alloc_count++; bmp_l1_stats.alloc_bytes += (size); } while(0)
+#define BMP_L1_STATS_FREE()             do { bmp_l1_stats.free_count++; } while(0)
+#else
+#define BMP_L1_STATS_BEGIN()            ((void)0)
+#define BMP_L1_STATS_END(api, px, by)   do { (void)sizeof(px); (void)sizeof(by); } while(0)
+#define BMP_L1_STATS_ALLOC(size)        ((void)0)
+#define BMP_L1_STATS_FREE()             ((void)0)
+#endif
+
+#define BMP_L1_DL_ALIGN(size)   (((size) + 7) & ~(uint32_t)7)
+
+#define BMP_L1_PATCH_HEADER_SIZE    20  // magic, size, width, height, number of ranges
+#define BMP_L1_PATCH_RANGE_SIZE     8   // first row, number of rows
+#define BMP_L1_PATCH_MERGE_ROWS     2   // unchanged rows merged into a range rather than starting a new one
+
+#define BMP_L1_ENCODE_BUFFER_SIZE   256 // output buffer of BMP_L1_writePBM [byte]
+#define BMP_L1_PNG_WINDOW_SIZE      (1u << BMP_L1_PNG_WINDOW_BITS)
+#define BMP_L1_PNG_WINDOW_MASK      (BMP_L1_PNG_WINDOW_SIZE - 1)
+#define BMP_L1_PNG_LOOKAHEAD        (258 + 3)   // longest match + hash bytes
+#define BMP_L1_PNG_MAX_DIST         (BMP_L1_PNG_WINDOW_SIZE - BMP_L1_PNG_LOOKAHEAD - 1)
+
+// Maximum number of batch jobs rendered ahead of the oldest result not yet handed out, per thread.
+#define BMP_L1_BATCH_LOOKAHEAD  8
+
 /* Private types -------------------------------------------------------------*/
 /* Private enum tag ----------------------------------------------------------*/
+typedef enum
+{
+    BMP_L1_DL_LINE = 0,     // payload: int32_t x0, y0, x1, y1
+    BMP_L1_DL_RECT,         // payload: none (bounding box is the rectangle)
+    BMP_L1_DL_TEXT,         // payload: BMP_L1_font_st, NUL-terminated text
+    BMP_L1_DL_BLIT          // payload: uint8_t * source image
+} BMP_L1_dl_type_e;
+
 /* Private struct/union tag --------------------------------------------------*/
+// Header of a recorded command. The payload follows; records are 8-byte aligned.
+typedef struct
+{
+    uint8_t  type;          // BMP_L1_dl_type_e
+    uint8_t  isWhite;
+    uint16_t reserved;
+    uint32_t size;          // record size including this header [byte]
+    int32_t  x0, y0;        // bounding box on the canvas (inclusive) [pixel]
+    int32_t  x1, y1;
+} BMP_L1_dl_cmd_st;
+
+struct BMP_L1_dlist
+{
+    uint32_t width;         // canvas width  [pixel]
+    uint32_t height;        // canvas height [pixel]
+    uint8_t *buf;           // recorded commands
+    uint32_t size;          // used bytes of buf
+    uint32_t capacity;      // allocated bytes of buf
+};
+
+// PackBits-style run-length encoder of a patch.
+typedef struct
+{
+    uint8_t *out;           // destination. NULL: only count bytes
+    uint32_t size;          // bytes produced
+    uint8_t  lit[128];      // pending literal bytes
+    uint32_t nlit;
+    uint8_t  run_byte;      // pending repeated byte
+    uint32_t run_len;
+} BMP_L1_rle_st;
+
+// State of BMP_L1_writePNG.
+typedef struct
+{
+    BMP_L1_write_Function write;
+    void *ctx;
+    int status;                                 // 0: ok, -1: write failed
+    uint8_t  window[BMP_L1_PNG_WINDOW_SIZE];    // ring buffer of filtered scanline data
+    uint32_t head[1u << BMP_L1_PNG_HASH_BITS];  // latest position + 1 per hash, 0: none
+    uint32_t pos_in;                            // bytes fed
+    uint32_t pos_cur;                           // bytes encoded
+    uint32_t pos_block;                         // first byte of the current block
+    uint16_t sym[BMP_L1_PNG_BLOCK_SYMBOLS];     // symbols of the current block: literal, or 256 + length then distance
+    uint32_t nsym;
+    uint32_t block_bits;                        // size of the current block with fixed Huffman codes, excluding its header
+    uint32_t bitbuf;
+    uint32_t bitcount;
+    uint32_t adler_a;
+    uint32_t adler_b;
+    uint8_t  out[BMP_L1_PNG_IDAT_SIZE];         // pending IDAT data
+    uint32_t nout;
+} BMP_L1_png_st;
+
+#ifdef BMP_L1_USE_PTHREAD
+// State shared by the workers of BMP_L1_dlist_renderParallel.
+typedef struct
+{
+    BMP_L1_dlist_st *dl;
+    uint32_t band_height;
+    uint32_t band_num;
+    BMP_L1_band_Function sink;
+    void *ctx;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    uint32_t next_band;     // next band to render
+    uint32_t next_emit;     // next band to hand to the sink
+    int status;             // 0: running, otherwise: aborted
+#ifdef BMP_L1_ENABLE_STATS
+    BMP_L1_stats_st stats;  // counters of the spawned workers, protected by lock
+#endif
+} BMP_L1_bandjob_st;
+
+// Image owned by a batch worker, allocated together with this node.
+// Reused for later jobs once its result was handed out.
+typedef struct BMP_L1_pool_image
+{
+    struct BMP_L1_pool_image *next;
+    uint8_t *pbmp;                  // points just after this node
+    uint32_t capacity;              // bytes available at pbmp
+    atomic_int in_use;
+} BMP_L1_pool_image_st;
+
+typedef struct
+{
+    BMP_L1_pool_image_st *head;
+} BMP_L1_pool_st;
+
+typedef struct
+{
+    BMP_L1_pool_image_st *image;    // NULL when the job failed
+    atomic_int done;
+} BMP_L1_batch_slot_st;
+
+// State shared by the workers of BMP_L1_renderBatch.
+typedef struct
+{
+    const BMP_L1_job_st *jobs;
+    uint32_t count;
+    const BMP_L1_batch_st *batch;
+    uint32_t lookahead;
+    BMP_L1_batch_slot_st *slots;
+    BMP_L1_pool_st *pools;          // one per worker
+    atomic_uint next_job;           // next job to claim
+    atomic_uint next_emit;          // next result to hand out
+    atomic_int status;              // 0: running, otherwise: a job failed or the batch was aborted
+    atomic_int aborted;
+    atomic_uint emit_pending;       // emit requests not yet served, non-zero while results are handed out
+    uint32_t active;                // workers still taking jobs, protected by lock
+    pthread_mutex_t lock;           // protects waiting on cond
+    pthread_cond_t  cond;           // signalled when next_emit advances or active drops
+#ifdef BMP_L1_ENABLE_STATS
+    BMP_L1_stats_st stats;          // counters of the spawned workers, protected by lock
+#endif
+} BMP_L1_batchjob_st;
+
+typedef struct
+{
+    BMP_L1_batchjob_st *job;
+    uint32_t worker;
+} BMP_L1_batchworker_st;
+#endif
+
 /* Private variables ---------------------------------------------------------*/
-static BMP_L1_Malloc_Function bmp_l1_malloc = malloc;
-static BMP_L1_free_Function bmp_l1_free = free;
+static BMP_L1_Malloc_Function bmp_l1_global_malloc = malloc;
+static BMP_L1_free_Function bmp_l1_global_free = free;
+#ifdef BMP_L1_USE_PTHREAD
+static BMP_L1_THREAD_LOCAL BMP_L1_Malloc_Function bmp_l1_thread_malloc = NULL;
+static BMP_L1_THREAD_LOCAL BMP_L1_free_Function bmp_l1_thread_free = NULL;
+#endif
+#ifdef BMP_L1_ENABLE_STATS
+static BMP_L1_THREAD_LOCAL BMP_L1_stats_st bmp_l1_stats;
+#endif
 
 #ifdef USE_FONT_4X6
 static const uint8_t font_4x6[256][6]={{0x00,0x00,0x00,0x00,0x00,0x00}, {0x20,0x50,0x70,0x50,0x20,0x00}, {0x20,0x70,0x50,0x70,0x20,0x00}, {0x00,0x50,0x70,0x70,0x20,0x00}, {0x00,0x20,0x70,0x70,0x20,0x00}, {0x20,0x70,0x70,0x20,0x70,0x00}, {0x20,0x20,0x70,0x20,0x70,0x00}, {0x00,0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x00,0x00,0x00,0x00}, {0x00,0x30,0x10,0x60,0x60,0x00}, {0x20,0x50,0x20,0x70,0x20,0x00}, {0x00,0x00,0x00,0x00,0x00,0x00}, {0x20,0x30,0x50,0x10,0x20,0x00}, {0x20,0x70,0x50,0x70,0x20,0x00}, {0x40,0x60,0x70,0x60,0x40,0x00}, {0x10,0x30,0x70,0x30,0x10,0x00}, {0x20,0x70,0x20,0x70,0x20,0x00}, {0x50,0x50,0x50,0x00,0x50,0x00}, {0x00,0x10,0x20,0x20,0x20,0x20}, {0x20,0x20,0x20,0x20,0x40,0x00}, {0x00,0x00,0x00,0x00,0x70,0x00}, {0x20,0x70,0x20,0x70,0x20,0x70}, {0x20,0x70,0x20,0x20,0x20,0x00}, {0x20,0x20,0x20,0x70,0x20,0x00}, {0x00,0x20,0xF0,0x20,0x00,0x00}, {0x00,0x40,0xF0,0x40,0x00,0x00}, {0x00,0x00,0x40,0x70,0x00,0x00}, {0x00,0x50,0x70,0x50,0x00,0x00}, {0x00,0x20,0x70,0x70,0x00,0x00}, {0x00,0x70,0x70,0x20,0x00,0x00}, {0x00,0x00,0x00,0x00,0x00,0x00}, {0x20,0x20,0x20,0x00,0x20,0x00}, {0x50,0x50,0x00,0x00,0x00,0x00}, {0x50,0x70,0x50,0x70,0x50,0x00}, {0x20,0x30,0x60,0x30,0x60,0x20}, {0x40,0x10,0x20,0x40,0x10,0x00}, {0x20,0x50,0x30,0x50,0x70,0x00}, {0x60,0x40,0x00,0x00,0x00,0x00}, {0x20,0x40,0x40,0x40,0x20,0x00}, {0x40,0x20,0x20,0x20,0x40,0x00}, {0x50,0x20,0x70,0x20,0x50,0x00}, {0x00,0x20,0x70,0x20,0x00,0x00}, {0x00,0x00,0x00,0x00,0x60,0x40}, {0x00,0x00,0x70,0x00,0x00,0x00}, {0x00,0x00,0x00,0x00,0x20,0x00}, {0x10,0x10,0x20,0x40,0x40,0x00}, {0x30,0x50,0x50,0x50,0x60,0x00}, {0x20,0x60,0x20,0x20,0x70,0x00}, {0x60,0x10,0x20,0x40,0x70,0x00}, {0x60,0x10,0x20,0x10,0x60,0x00}, {0x10,0x50,0x70,0x10,0x10,0x00}, {0x70,0x40,0x60,0x10,0x60,0x00}, {0x20,0x40,0x60,0x50,0x20,0x00}, {0x70,0x10,0x30,0x20,0x20,0x00}, {0x20,0x50,0x20,0x50,0x20,0x00}, {0x20,0x50,0x30,0x10,0x20,0x00}, {0x00,0x00,0x20,0x00,0x20,0x00}, {0x00,0x00,0x20,0x00,0x60,0x40}, {0x10,0x20,0x40,0x20,0x10,0x00}, {0x00,0x00,0x70,0x00,0x70,0x00}, {0x40,0x20,0x10,0x20,0x40,0x00}, {0x60,0x10,0x20,0x00,0x20,0x00}, {0x70,0x50,0x50,0x40,0x70,0x00}, {0x20,0x50,0x70,0x50,0x50,0x00}, {0x60,0x50,0x60,0x50,0x60,0x00}, {0x30,0x40,0x40,0x40,0x30,0x00}, {0x60,0x50,0x50,0x50,0x60,0x00}, {0x70,0x40,0x60,0x40,0x70,0x00}, {0x70,0x40,0x60,0x40,0x40,0x00}, {0x30,0x40,0x50,0x50,0x30,0x00}, {0x50,0x50,0x70,0x50,0x50,0x00}, {0x70,0x20,0x20,0x20,0x70,0x00}, {0x10,0x10,0x10,0x50,0x20,0x00}, {0x50,0x50,0x60,0x50,0x50,0x00}, {0x40,0x40,0x40,0x40,0x70,0x00}, {0x50,0x70,0x70,0x50,0x50,0x00}, {0x50,0x70,0x50,0x50,0x50,0x00}, {0x20,0x50,0x50,0x50,0x20,0x00}, {0x60,0x50,0x60,0x40,0x40,0x00}, {0x20,0x50,0x50,0x70,0x30,0x00}, {0x60,0x50,0x60,0x50,0x50,0x00}, {0x30,0x40,0x70,0x10,0x60,0x00}, {0x70,0x20,0x20,0x20,0x20,0x00}, {0x50,0x50,0x50,0x50,0x70,0x00}, {0x50,0x50,0x50,0x50,0x20,0x00}, {0x50,0x50,0x70,0x70,0x50,0x00}, {0x50,0x50,0x20,0x50,0x50,0x00}, {0x50,0x50,0x20,0x20,0x20,0x00}, {0x70,0x10,0x20,0x40,0x70,0x00}, {0x60,0x40,0x40,0x40,0x60,0x00}, {0x40,0x40,0x20,0x10,0x10,0x00}, {0x60,0x20,0x20,0x20,0x60,0x00}, {0x20,0x50,0x00,0x00,0x00,0x00}, {0x00,0x00,0x00,0x00,0x00,0xF0}, {0x60,0x20,0x00,0x00,0x00,0x00}, {0x00,0x00,0x30,0x50,0x70,0x00}, {0x40,0x40,0x60,0x50,0x60,0x00}, {0x00,0x00,0x30,0x40,0x30,0x00}, {0x10,0x10,0x30,0x50,0x30,0x00}, {0x00,0x00,0x70,0x60,0x30,0x00}, {0x10,0x20,0x70,0x20,0x20,0x00}, {0x00,0x00,0x70,0x50,0x10,0x70}, {0x40,0x40,0x60,0x50,0x50,0x00}, {0x20,0x00,0x20,0x20,0x20,0x00}, {0x20,0x00,0x20,0x20,0x20,0x60}, {0x40,0x40,0x50,0x60,0x50,0x00}, {0x20,0x20,0x20,0x20,0x20,0x00}, {0x00,0x00,0x70,0x70,0x50,0x00}, {0x00,0x00,0x60,0x50,0x50,0x00}, {0x00,0x00,0x20,0x50,0x20,0x00}, {0x00,0x00,0x60,0x50,0x60,0x40}, {0x00,0x00,0x30,0x50,0x30,0x10}, {0x00,0x00,0x60,0x40,0x40,0x00}, {0x00,0x00,0x30,0x20,0x60,0x00}, {0x00,0x20,0x70,0x20,0x30,0x00}, {0x00,0x00,0x50,0x50,0x70,0x00}, {0x00,0x00,0x50,0x50,0x20,0x00}, {0x00,0x00,0x50,0x70,0x70,0x00}, {0x00,0x00,0x50,0x20,0x50,0x00}, {0x00,0x00,0x50,0x50,0x20,0x40}, {0x00,0x00,0x60,0x20,0x30,0x00}, {0x30,0x20,0x60,0x20,0x30,0x00}, {0x20,0x20,0x20,0x20,0x20,0x00}, {0x60,0x20,0x30,0x20,0x60,0x00}, {0x50,0xA0,0x00,0x00,0x00,0x00}, {0x00,0x20,0x50,0x70,0x00,0x00}, {0x30,0x40,0x40,0x70,0x20,0x40}, {0x50,0x00,0x50,0x50,0x30,0x00}, {0x10,0x20,0x70,0x60,0x30,0x00}, {0x20,0x50,0x30,0x50,0x70,0x00}, {0x50,0x00,0x30,0x50,0x70,0x00}, {0x40,0x20,0x30,0x50,0x70,0x00}, {0x20,0x00,0x30,0x50,0x70,0x00}, {0x00,0x70,0x40,0x70,0x20,0x60}, {0x20,0x50,0x70,0x60,0x30,0x00}, {0x50,0x00,0x70,0x60,0x30,0x00}, {0x40,0x20,0x70,0x60,0x30,0x00}, {0x50,0x00,0x20,0x20,0x20,0x00}, {0x20,0x50,0x00,0x20,0x20,0x00}, {0x40,0x20,0x00,0x20,0x20,0x00}, {0x50,0x20,0x50,0x70,0x50,0x00}, {0x20,0x20,0x50,0x70,0x50,0x00}, {0x10,0x20,0x70,0x60,0x70,0x00}, {0x00,0x00,0x30,0x70,0x60,0x00}, {0x30,0x60,0x70,0x60,0x70,0x00}, {0x20,0x50,0x20,0x50,0x20,0x00}, {0x50,0x00,0x20,0x50,0x20,0x00}, {0x40,0x20,0x20,0x50,0x20,0x00}, {0x20,0x50,0x00,0x50,0x70,0x00}, {0x40,0x20,0x50,0x50,0x70,0x00}, {0x50,0x00,0x50,0x50,0x20,0x40}, {0x50,0x20,0x50,0x50,0x20,0x00}, {0x50,0x00,0x50,0x50,0x70,0x00}, {0x20,0x70,0x40,0x70,0x20,0x00}, {0x10,0x20,0x70,0x20,0x70,0x00}, {0x50,0x70,0x20,0x70,0x20,0x00}, {0x00,0x60,0x60,0x50,0x50,0x00}, {0x30,0x20,0x30,0x20,0x60,0x00}, {0x10,0x20,0x30,0x50,0x70,0x00}, {0x10,0x20,0x00,0x20,0x20,0x00}, {0x10,0x20,0x70,0x50,0x70,0x00}, {0x10,0x20,0x00,0x50,0x70,0x00}, {0x70,0x00,0x70,0x50,0x50,0x00}, {0x70,0x00,0x50,0x70,0x50,0x00}, {0x30,0x50,0x70,0x00,0x70,0x00}, {0x20,0x50,0x20,0x00,0x70,0x00}, {0x20,0x00,0x20,0x40,0x30,0x00}, {0x00,0x70,0x40,0x40,0x00,0x00}, {0x00,0xE0,0x20,0x20,0x00,0x00}, {0x40,0x50,0x20,0x50,0x30,0x00}, {0x40,0x50,0x20,0x70,0x10,0x00}, {0x20,0x00,0x20,0x20,0x20,0x00}, {0x00,0x50,0xA0,0x50,0x00,0x00}, {0x00,0xA0,0x50,0xA0,0x00,0x00}, {0x40,0x10,0x40,0x10,0x40,0x10}, {0x50,0xA0,0x50,0xA0,0x50,0xA0}, {0xB0,0xE0,0xB0,0xE0,0xB0,0xE0}, {0x20,0x20,0x20,0x20,0x20,0x20}, {0x20,0x20,0xE0,0x20,0x20,0x20}, {0x20,0xE0,0x20,0xE0,0x20,0x20}, {0x50,0x50,0xD0,0x50,0x50,0x50}, {0x00,0x00,0xF0,0x50,0x50,0x50}, {0x00,0xE0,0x20,0xE0,0x20,0x20}, {0x50,0xD0,0x10,0xD0,0x50,0x50}, {0x50,0x50,0x50,0x50,0x50,0x50}, {0x00,0xF0,0x10,0xD0,0x50,0x50}, {0x50,0xD0,0x10,0xF0,0x00,0x00}, {0x50,0x50,0xF0,0x00,0x00,0x00}, {0x20,0xE0,0x20,0xE0,0x00,0x00}, {0x00,0x00,0xE0,0x20,0x20,0x20}, {0x20,0x20,0x30,0x00,0x00,0x00}, {0x20,0x20,0xF0,0x00,0x00,0x00}, {0x00,0x00,0xF0,0x20,0x20,0x20}, {0x20,0x20,0x30,0x20,0x20,0x20}, {0x00,0x00,0xF0,0x00,0x00,0x00}, {0x20,0x20,0xF0,0x20,0x20,0x20}, {0x20,0x30,0x20,0x30,0x20,0x20}, {0x50,0x50,0x50,0x50,0x50,0x50}, {0x50,0x50,0x40,0x70,0x00,0x00}, {0x00,0x70,0x40,0x50,0x50,0x50}, {0x50,0xD0,0x00,0xF0,0x00,0x00}, {0x00,0xF0,0x00,0xD0,0x50,0x50}, {0x50,0x50,0x40,0x50,0x50,0x50}, {0x00,0xF0,0x00,0xF0,0x00,0x00}, {0x50,0xD0,0x00,0xD0,0x50,0x50}, {0x20,0xF0,0x00,0xF0,0x00,0x00}, {0x50,0x50,0xF0,0x00,0x00,0x00}, {0x00,0xF0,0x00,0xF0,0x20,0x20}, {0x00,0x00,0xF0,0x50,0x50,0x50}, {0x50,0x50,0x70,0x00,0x00,0x00}, {0x20,0x30,0x20,0x30,0x00,0x00}, {0x00,0x30,0x20,0x30,0x20,0x20}, {0x00,0x00,0x70,0x50,0x50,0x50}, {0x50,0x50,0xD0,0x50,0x50,0x50}, {0x20,0xF0,0x00,0xF0,0x20,0x20}, {0x20,0x20,0xE0,0x00,0x00,0x00}, {0x00,0x00,0x30,0x20,0x20,0x20}, {0xF0,0xF0,0xF0,0xF0,0xF0,0xF0}, {0x00,0x00,0x00,0xF0,0xF0,0xF0}, {0xC0,0xC0,0xC0,0xC0,0xC0,0xC0}, {0x30,0x30,0x30,0x30,0x30,0x30}, {0xF0,0xF0,0xF0,0x00,0x00,0x00}, {0x00,0x00,0x70,0x60,0x70,0x00}, {0x20,0x50,0x60,0x50,0x60,0x40}, {0x70,0x50,0x40,0x40,0x40,0x00}, {0x70,0x50,0x50,0x50,0x50,0x00}, {0x70,0x40,0x20,0x40,0x70,0x00}, {0x00,0x00,0x30,0x50,0x20,0x00}, {0x00,0x00,0x50,0x50,0x70,0x40}, {0x00,0x10,0x60,0x20,0x20,0x00}, {0x70,0x20,0x50,0x20,0x70,0x00}, {0x20,0x50,0x70,0x50,0x20,0x00}, {0x00,0x20,0x50,0x50,0x50,0x00}, {0x30,0x40,0x20,0x50,0x20,0x00}, {0x00,0x00,0x70,0x50,0x70,0x00}, {0x20,0x70,0x50,0x70,0x20,0x00}, {0x30,0x40,0x70,0x40,0x30,0x00}, {0x20,0x50,0x50,0x50,0x50,0x00}, {0x70,0x00,0x70,0x00,0x70,0x00}, {0x20,0x70,0x20,0x00,0x70,0x00}, {0x60,0x10,0x60,0x00,0x70,0x00}, {0x30,0x40,0x30,0x00,0x70,0x00}, {0x00,0x10,0x20,0x20,0x20,0x20}, {0x20,0x20,0x20,0x20,0x40,0x00}, {0x20,0x00,0x70,0x00,0x20,0x00}, {0x00,0x50,0xA0,0x50,0xA0,0x00}, {0x20,0x50,0x20,0x00,0x00,0x00}, {0x00,0x20,0x70,0x20,0x00,0x00}, {0x00,0x00,0x20,0x00,0x00,0x00}, {0x30,0x20,0x20,0x60,0x20,0x00}, {0x70,0x50,0x50,0x00,0x00,0x00}, {0x60,0x20,0x40,0x60,0x00,0x00}, {0x00,0x00,0x60,0x60,0x00,0x00}, {0x00,0x00,0x00,0x00,0x00,0x00}};
@@ -113,13 +311,20 @@ const BMP_L1_font_st BMP_L1_FONT_32X53	= {(uint8_t *)font_32x53,32,53};
 
 /* Exported function prototypes ----------------------------------------------*/
 void	  BMP_L1_setAllocFunc(BMP_L1_Malloc_Function, BMP_L1_free_Function);
+#ifdef BMP_L1_USE_PTHREAD
+void      BMP_L1_setThreadAllocFunc(BMP_L1_Malloc_Function, BMP_L1_free_Function);
+#endif
 uint8_t * BMP_L1_create      (uint32_t, uint32_t);
+uint8_t * BMP_L1_createEx    (uint32_t, uint32_t, uint8_t);
 void      BMP_L1_free        (uint8_t *);
 uint32_t  BMP_L1_getWidth    (uint8_t *);
 uint32_t  BMP_L1_getHeight   (uint8_t *);
 uint32_t  BMP_L1_getFileSize (uint8_t *);
 uint32_t  BMP_L1_getImageSize(uint8_t *);
 uint32_t  BMP_L1_getOffset   (uint8_t *);
+uint8_t   BMP_L1_isTopDown   (uint8_t *);
+uint32_t  BMP_L1_getStride   (uint8_t *);
+uint8_t * BMP_L1_getRow      (uint8_t *, uint32_t);
 void      BMP_L1_setPixel (uint8_t *, uint32_t, uint32_t, uint8_t);
 void      BMP_L1_getPixel (uint8_t *, uint32_t, uint32_t, uint8_t *);
 void      BMP_L1_drawLine (uint8_t *, int32_t, int32_t, int32_t, int32_t, uint8_t);
@@ -127,8 +332,88 @@ void      BMP_L1_drawRect (uint8_t *, uint32_t, uint32_t, uint32_t, uint32_t, ui
 void      BMP_L1_fill     (uint8_t *, uint8_t);
 uint8_t * BMP_L1_copy(uint8_t *);
 uint8_t * BMP_L1_resize_bicubic(uint8_t *, uint32_t, uint32_t);
+uint8_t * BMP_L1_resize_nearest(uint8_t *, uint32_t, uint32_t);
+uint8_t * BMP_L1_warpAffine   (uint8_t *, const float *, uint32_t, uint32_t, uint8_t);
+void      BMP_L1_blit         (uint8_t *, uint8_t *, int32_t, int32_t);
+uint8_t   BMP_L1_equal        (uint8_t *, uint8_t *);
+uint8_t * BMP_L1_diff         (uint8_t *, uint8_t *);
+uint32_t  BMP_L1_getPatchSize (uint8_t *);
+int       BMP_L1_applyPatch   (uint8_t *, uint8_t *, uint32_t);
+int       BMP_L1_writePBM     (uint8_t *, BMP_L1_write_Function, void *);
+int       BMP_L1_writePNG     (uint8_t *, BMP_L1_write_Function, void *);
+BMP_L1_dlist_st * BMP_L1_dlist_create(uint32_t, uint32_t);
+void      BMP_L1_dlist_free    (BMP_L1_dlist_st *);
+int       BMP_L1_dlist_drawLine(BMP_L1_dlist_st *, int32_t, int32_t, int32_t, int32_t, uint8_t);
+int       BMP_L1_dlist_drawRect(BMP_L1_dlist_st *, uint32_t, uint32_t, uint32_t, uint32_t, uint8_t);
+int       BMP_L1_dlist_fill    (BMP_L1_dlist_st *, uint8_t);
+int       BMP_L1_dlist_drawText(BMP_L1_dlist_st *, char *, BMP_L1_font_st, uint32_t, uint32_t, uint8_t);
+int       BMP_L1_dlist_blit    (BMP_L1_dlist_st *, uint8_t *, int32_t, int32_t);
+int       BMP_L1_dlist_render  (BMP_L1_dlist_st *, uint32_t, BMP_L1_band_Function, void *);
+#ifdef BMP_L1_USE_PTHREAD
+int       BMP_L1_dlist_renderParallel(BMP_L1_dlist_st *, uint32_t, uint32_t, BMP_L1_band_Function, void *);
+int       BMP_L1_renderBatch(const BMP_L1_job_st *, uint32_t, const BMP_L1_batch_st *);
+#endif
+#ifdef BMP_L1_ENABLE_STATS
+void      BMP_L1_getStats  (BMP_L1_stats_st *);
+void      BMP_L1_resetStats(void);
+#endif
 
 /* Private function prototypes -----------------------------------------------*/
+static int32_t BMP_L1_getPitch(uint8_t *);
+static inline void *BMP_L1_allocMem(size_t);
+static inline void BMP_L1_freeMem(void *);
+static uint8_t *BMP_L1_createImage(uint32_t, uint32_t, uint8_t);
+static void BMP_L1_freeImage(uint8_t *);
+static void BMP_L1_setHeight(uint8_t *, uint32_t);
+static void BMP_L1_writeHeader(uint8_t *, uint32_t, uint32_t, uint8_t);
+static void BMP_L1_copyBits(uint8_t *, uint32_t, const uint8_t *, uint32_t, uint32_t);
+static void BMP_L1_fillSpan(uint8_t *, uint32_t, uint32_t, uint8_t);
+static uint32_t BMP_L1_blitImage(uint8_t *, uint8_t *, int32_t, int32_t);
+static int64_t BMP_L1_floorDiv(int64_t, int64_t);
+static void BMP_L1_warpClip(int64_t, int64_t, int64_t, int64_t, int32_t *, int32_t *);
+static uint32_t BMP_L1_warpSample(const uint8_t *, int32_t, int32_t, int32_t);
+static void BMP_L1_spreadTable(uint8_t *, uint32_t);
+static void BMP_L1_spreadRow(uint8_t *, const uint8_t *, const uint8_t *, uint32_t, uint32_t);
+static void BMP_L1_renderLine(uint8_t *, int32_t, int32_t, int32_t, int32_t, uint8_t);
+static void BMP_L1_renderText(uint8_t *, const char *, BMP_L1_font_st, int32_t, int32_t, uint8_t);
+static void *BMP_L1_dlist_append(BMP_L1_dlist_st *, BMP_L1_dl_type_e, uint8_t, uint32_t, int32_t, int32_t, int32_t, int32_t);
+static void BMP_L1_dlist_renderBand(BMP_L1_dlist_st *, uint8_t *, uint32_t);
+static uint8_t BMP_L1_rowsEqual(const uint8_t *, const uint8_t *, uint32_t);
+static uint32_t BMP_L1_diff_encode(uint8_t *, uint8_t *, uint8_t *);
+static int BMP_L1_diff_decode(uint8_t *, uint8_t *, uint8_t *, uint32_t, uint64_t *);
+static void BMP_L1_rle_put(BMP_L1_rle_st *, uint8_t);
+static void BMP_L1_rle_literals(BMP_L1_rle_st *);
+static void BMP_L1_rle_flush(BMP_L1_rle_st *, uint8_t);
+static void BMP_L1_rle_byte(BMP_L1_rle_st *, uint8_t);
+static void BMP_L1_write_uint32_t_be(uint32_t, uint8_t *);
+static uint32_t BMP_L1_crc32(uint32_t, const uint8_t *, uint32_t);
+static void BMP_L1_png_chunk(BMP_L1_png_st *, const char *, const uint8_t *, uint32_t);
+static void BMP_L1_png_byte(BMP_L1_png_st *, uint8_t);
+static void BMP_L1_png_bits(BMP_L1_png_st *, uint32_t, uint32_t);
+static void BMP_L1_png_code(BMP_L1_png_st *, uint32_t, uint32_t);
+static void BMP_L1_png_symbol(BMP_L1_png_st *, uint32_t);
+static uint32_t BMP_L1_png_match(BMP_L1_png_st *, uint32_t, uint32_t, uint8_t);
+static void BMP_L1_png_block(BMP_L1_png_st *, uint8_t);
+static uint32_t BMP_L1_png_hash(BMP_L1_png_st *, uint32_t);
+static void BMP_L1_png_step(BMP_L1_png_st *);
+static void BMP_L1_png_feed(BMP_L1_png_st *, uint8_t);
+#ifdef BMP_L1_USE_PTHREAD
+static void *BMP_L1_dlist_worker(void *);
+static void *BMP_L1_dlist_thread(void *);
+static BMP_L1_pool_image_st *BMP_L1_pool_acquire(BMP_L1_pool_st *, uint32_t);
+static void BMP_L1_batch_emit(BMP_L1_batchjob_st *);
+static void *BMP_L1_batch_worker(void *);
+static void *BMP_L1_batch_thread(void *);
+#endif
+static void BMP_L1_putPixel (uint8_t *, uint32_t, uint32_t, uint8_t);
+static void BMP_L1_peekPixel(uint8_t *, uint32_t, uint32_t, uint8_t *);
+static uint32_t BMP_L1_fillRect(uint8_t *, uint32_t, uint32_t, uint32_t, uint32_t, uint8_t);
+#ifdef BMP_L1_ENABLE_STATS
+static void BMP_L1_stats_add(BMP_L1_api_e, uint64_t, uint64_t, uint64_t);
+#ifdef BMP_L1_USE_PTHREAD
+static void BMP_L1_stats_sum(BMP_L1_stats_st *, const BMP_L1_stats_st *);
+#endif
+#endif
 static uint32_t BMP_L1_read_uint32_t(uint8_t *);
 static uint16_t BMP_L1_read_uint16_t(uint8_t *);
 static void BMP_L1_write_uint32_t(uint32_t, uint8_t *);
@@ -146,67 +431,54 @@ static uint32_t BMP_L1_getBytesPerRow(uint32_t);
   */
 void BMP_L1_setAllocFunc(BMP_L1_Malloc_Function malloc_func, BMP_L1_free_Function free_func)
 {
-	bmp_l1_malloc = malloc_func;
-	bmp_l1_free = free_func;
+	bmp_l1_global_malloc = malloc_func;
+	bmp_l1_global_free = free_func;
+}
+
+#ifdef BMP_L1_USE_PTHREAD
+/**
+  * @brief  Set memory allocation funciton of the calling thread only.
+  * 		Overrides BMP_L1_setAllocFunc() for allocations made on this thread,
+  * 		e.g. to give each worker thread its own arena.
+  * 		Memory must be freed with the same functions, so images must not move between contexts.
+  * @param  malloc_func memory allocate function. NULL: use the global function again.
+  * @param  free_func memory free function. NULL: use the global function again.
+  * @retval None
+  */
+void BMP_L1_setThreadAllocFunc(BMP_L1_Malloc_Function malloc_func, BMP_L1_free_Function free_func)
+{
+	bmp_l1_thread_malloc = malloc_func;
+	bmp_l1_thread_free = free_func;
 }
+#endif
 
 /**
   * @brief  Create BMP L1 image.
   * @param  width width of image [pixel]
   * @param  height height of image [pixel]
   * @retval pointer to the created image. When error, return NULL
+  * @detail Rows are stored bottom-up. Same as BMP_L1_createEx(width, height, BMP_L1_BOTTOM_UP).
   */
 uint8_t *BMP_L1_create(uint32_t width, uint32_t height)
 {
-    uint8_t *pbmp;
-    uint32_t bytes_per_row = BMP_L1_getBytesPerRow(width);
-    uint32_t image_size = bytes_per_row * height;
-    uint32_t data_size = AllHeaderOffset + image_size;
-
-    /* Allocate the bitmap data */
-    pbmp = (uint8_t *)bmp_l1_malloc(sizeof(uint8_t) * data_size);
-    if (pbmp == NULL)
-        return NULL;
-    for(uint32_t i = 0; i < data_size; i++)
-        *(pbmp + i) = 0;
-
-    // Set header's default values
-    uint8_t *tmp = pbmp;
-    *(tmp  +  0) = 'B';                                    // 'B' : Magic number
-    *(tmp  +  1) = 'M';                                    // 'M' : Magic number
-    BMP_L1_write_uint32_t(data_size        , tmp + 0x02);  // File Size
-    BMP_L1_write_uint16_t(0                , tmp + 0x06);  // Reserved1
-    BMP_L1_write_uint16_t(0                , tmp + 0x08);  // Reserved2
-    BMP_L1_write_uint32_t(AllHeaderOffset  , tmp + 0x0A);  // Offset
-    tmp += BMP_L1_FILE_HEADER_SIZE;    // Next
-
-    // Info header
-    BMP_L1_write_uint32_t( BMP_L1_INFO_HEADER_SIZE  , tmp + 0x00);   // HeaderSize
-    BMP_L1_write_uint32_t( width           , tmp + 0x04);  // width  (*** Signed value ***)
-    BMP_L1_write_uint32_t( height          , tmp + 0x08);  // height (*** Signed value ***)
-    BMP_L1_write_uint16_t( 1               , tmp + 0x0C);  // planes
-    BMP_L1_write_uint16_t( 1               , tmp + 0x0E);  // Bit count
-    BMP_L1_write_uint32_t( 0               , tmp + 0x10);  // Bit compression
-    BMP_L1_write_uint32_t( image_size      , tmp + 0x14);  // Image size
-    BMP_L1_write_uint32_t( 0               , tmp + 0x18);  // X pixels per meter
-    BMP_L1_write_uint32_t( 0               , tmp + 0x1C);  // Y pixels per meter
-    BMP_L1_write_uint32_t( 2               , tmp + 0x20);  // Color index
-    BMP_L1_write_uint32_t( 0               , tmp + 0x24);  // Important index
-    tmp += BMP_L1_INFO_HEADER_SIZE;    // Next
-
-    // Palette data
-    // Black
-    *tmp++ = 0;   // Blue
-    *tmp++ = 0;   // Greem
-    *tmp++ = 0;   // Red
-    *tmp++ = 0;   // Reserved
-
-    // White
-    *tmp++ = 0xFF;   // Blue
-    *tmp++ = 0xFF;   // Greem
-    *tmp++ = 0xFF;   // Red
-    *tmp++ = 0;      // Reserved
+    return BMP_L1_createEx(width, height, BMP_L1_BOTTOM_UP);
+}
 
+/**
+  * @brief  Create BMP L1 image with a given row order.
+  * @param  width width of image [pixel]
+  * @param  height height of image [pixel]
+  * @param  layout BMP_L1_BOTTOM_UP or BMP_L1_TOP_DOWN
+  * @retval pointer to the created image. When error, return NULL
+  * @detail A top-down image is written with a negative height, so row y is at
+  *         offset + y * stride and the pixel area can be streamed (e.g. by DMA)
+  *         forward through memory. All functions accept either layout.
+  */
+uint8_t *BMP_L1_createEx(uint32_t width, uint32_t height, uint8_t layout)
+{
+    BMP_L1_STATS_BEGIN();
+    uint8_t *pbmp = BMP_L1_createImage(width, height, layout);
+    BMP_L1_STATS_END(BMP_L1_API_CREATE, 0, pbmp != NULL ? BMP_L1_getFileSize(pbmp) : 0);
     return pbmp;
 }
 
@@ -217,7 +489,9 @@ uint8_t *BMP_L1_create(uint32_t width, uint32_t height)
   */
 void BMP_L1_free(uint8_t *pbmp)
 {
-	bmp_l1_free(pbmp);
+    BMP_L1_STATS_BEGIN();
+    BMP_L1_freeImage(pbmp);
+    BMP_L1_STATS_END(BMP_L1_API_FREE, 0, 0);
 }
 
 
@@ -238,7 +512,8 @@ uint32_t BMP_L1_getWidth(uint8_t *pbmp)
   */
 uint32_t BMP_L1_getHeight(uint8_t *pbmp)
 {
-    return BMP_L1_read_uint32_t(pbmp + BMP_L1_FILE_HEADER_SIZE + 0x08);
+    int32_t height = (int32_t)BMP_L1_read_uint32_t(pbmp + BMP_L1_FILE_HEADER_SIZE + 0x08);
+    return height < 0 ? (uint32_t)-height : (uint32_t)height;
 }
 
 /**
@@ -271,6 +546,40 @@ uint32_t BMP_L1_getOffset(uint8_t *pbmp)
     return BMP_L1_read_uint32_t(pbmp + 0x0A);
 }
 
+/**
+  * @brief  Get row order of a image.
+  * @param  pbmp pointer to a image
+  * @retval 1: top-down (negative height), 0: bottom-up
+  */
+uint8_t BMP_L1_isTopDown(uint8_t *pbmp)
+{
+    return (int32_t)BMP_L1_read_uint32_t(pbmp + BMP_L1_FILE_HEADER_SIZE + 0x08) < 0;
+}
+
+/**
+  * @brief  Get number of bytes of a row of a image, including padding.
+  * @param  pbmp pointer to a image
+  * @retval Stride [byte]
+  */
+uint32_t BMP_L1_getStride(uint8_t *pbmp)
+{
+    return BMP_L1_getBytesPerRow(BMP_L1_getWidth(pbmp));
+}
+
+/**
+  * @brief  Get pointer to the pixels of a row.
+  * @param  pbmp pointer to a image
+  * @param  y	y of a image(Range:[0,height-1]) [pixel]. 0 is the top row in either layout.
+  * @retval Pointer to the first byte of the row. Pixel x is bit (7 - x % 8) of byte x / 8, 1: white.
+  */
+uint8_t *BMP_L1_getRow(uint8_t *pbmp, uint32_t y)
+{
+    uint32_t bytes_per_row = BMP_L1_getBytesPerRow(BMP_L1_getWidth(pbmp));
+    if (BMP_L1_isTopDown(pbmp))
+        return pbmp + AllHeaderOffset + bytes_per_row * y;
+    return pbmp + AllHeaderOffset + bytes_per_row * (BMP_L1_getHeight(pbmp) - y - 1);
+}
+
 /**
   * @brief  Draw a color in RGB format on a specified pixel.
   * @param  pbmp pointer to a image
@@ -281,18 +590,9 @@ uint32_t BMP_L1_getOffset(uint8_t *pbmp)
   */
 void BMP_L1_setPixel(uint8_t *pbmp, uint32_t x, uint32_t y, uint8_t isWhite)
 {
-    uint32_t width  = BMP_L1_getWidth (pbmp);
-    uint32_t height = BMP_L1_getHeight (pbmp);
-
-    if(pbmp == NULL || x >= width || y >= height)
-        return;
-
-    uint32_t bytes_per_row = BMP_L1_getBytesPerRow(width);
-    uint8_t *pBuf = pbmp + AllHeaderOffset + bytes_per_row * (height - y - 1) + (x >> 3);
-    if(isWhite & 0x01)
-        *pBuf |=  (0x80 >> (x & 0x00000007));
-    else
-        *pBuf &= ~(0x80 >> (x & 0x00000007));
+    BMP_L1_STATS_BEGIN();
+    BMP_L1_putPixel(pbmp, x, y, isWhite);
+    BMP_L1_STATS_END(BMP_L1_API_SETPIXEL, 1, 1);
 }
 
 /**
@@ -305,18 +605,9 @@ void BMP_L1_setPixel(uint8_t *pbmp, uint32_t x, uint32_t y, uint8_t isWhite)
   */
 void BMP_L1_getPixel(uint8_t *pbmp, uint32_t x, uint32_t y, uint8_t *isWhite)
 {
-    uint32_t width  = BMP_L1_getWidth(pbmp);
-    uint32_t height = BMP_L1_getHeight(pbmp);
-
-    if(pbmp == NULL || x >= width || y >= height)
-        return;
-
-    uint32_t bytes_per_row = BMP_L1_getBytesPerRow(width);
-    uint8_t buf = *(pbmp + AllHeaderOffset + bytes_per_row * (height - y - 1) + (x >> 3) );
-    if(buf & (0x80 >> (x & 0x00000007)))
-        *isWhite = 1;
-    else
-        *isWhite = 0;
+    BMP_L1_STATS_BEGIN();
+    BMP_L1_peekPixel(pbmp, x, y, isWhite);
+    BMP_L1_STATS_END(BMP_L1_API_GETPIXEL, 1, 1);
 }
 
 /**
@@ -336,13 +627,15 @@ void BMP_L1_drawLine(uint8_t *pbmp,
 		int32_t x0, int32_t y0, int32_t x1, int32_t y1,
         uint8_t isWhite)
 {
+    BMP_L1_STATS_BEGIN();
     uint32_t width  = BMP_L1_getWidth (pbmp);
     uint32_t height = BMP_L1_getHeight (pbmp);
 
     if(pbmp == NULL || x0 < 0 || x0 >= width || x1 < 0 || x1 >= width || y0 < 0 || y0 >= height || y1 < 0 || y1 >= height)
+    {
+        BMP_L1_STATS_END(BMP_L1_API_DRAWLINE, 0, 0);
         return;
-
-    uint32_t bytes_per_row = BMP_L1_getBytesPerRow(width);
+    }
 
     int32_t dx = x1 - x0 > 0 ? x1 - x0 : x0 - x1;
     int32_t sx = x0 < x1 ? 1 : -1;
@@ -350,11 +643,13 @@ void BMP_L1_drawLine(uint8_t *pbmp,
     int32_t sy = y0 < y1 ? 1 : -1;
     int32_t err = dx - dy;
     int32_t e2;
+    uint32_t pixels = (dx > dy ? dx : dy) + 1;
 
-    uint8_t *pbmp_data = pbmp + AllHeaderOffset;
+    uint8_t *pbmp_data = BMP_L1_getRow(pbmp, 0);
+    int32_t pitch = BMP_L1_getPitch(pbmp);
     for (;;)
     {
-        uint8_t *pBuf = pbmp_data + bytes_per_row * (height - y0 - 1) + (x0 >> 3);
+        uint8_t *pBuf = pbmp_data + pitch * y0 + (x0 >> 3);
         if(isWhite & 0x01)
             *pBuf |=  (0x80 >> (x0 & 0x00000007));
         else
@@ -367,6 +662,7 @@ void BMP_L1_drawLine(uint8_t *pbmp,
         if (e2 > -dy) {err -= dy;   x0 += sx;}
         if (e2 <  dx) {err += dx;   y0 += sy;}
     }
+    BMP_L1_STATS_END(BMP_L1_API_DRAWLINE, pixels, pixels);
 }
 
 
@@ -384,45 +680,9 @@ void BMP_L1_drawRect(uint8_t *pbmp,
 		uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
         uint8_t isWhite)
 {
-    uint32_t width = BMP_L1_getWidth(pbmp);
-    uint32_t height = BMP_L1_getHeight(pbmp);
-
-    if (pbmp == NULL || x0 >= width || x1 >= width || y0 >= height || y1 >= height)
-        return;
-
-    uint32_t swap;
-    if(x0 > x1)
-    {
-        swap = x0;
-        x0 = x1;
-        x1 = swap;
-    }
-    if (y0 > y1)
-    {
-        swap = y0;
-        x0 = y1;
-        y1 = swap;
-    }
-
-    uint32_t bytes_per_row = BMP_L1_getBytesPerRow(width);
-    uint8_t *pbmp_data = pbmp + AllHeaderOffset;
-
-    int32_t y_addr_start = bytes_per_row*(height - y0 - 1);
-    int32_t y_addr_end   = bytes_per_row*(height - y1 - 1);
-    int32_t x_addr_start = x0;// * 2;
-    int32_t x_addr_end   = x1;// * 2;
-    for(int32_t y_addr = y_addr_start; y_addr >= y_addr_end; y_addr -= bytes_per_row)
-    {
-        uint8_t *pBuf = pbmp_data + bytes_per_row * (height - y0 - 1) + (x0 >> 3);
-
-        for(int32_t x_addr = x_addr_start; x_addr <= x_addr_end; x_addr += 1) {
-            uint8_t *pBuf = pbmp_data + y_addr + (x_addr >> 3);
-            if(isWhite & 0x01)
-                *pBuf |=  (0x80 >> (x_addr & 0x00000007));
-            else
-                *pBuf &= ~(0x80 >> (x_addr & 0x00000007));
-        }
-    }
+    BMP_L1_STATS_BEGIN();
+    uint32_t pixels = BMP_L1_fillRect(pbmp, x0, y0, x1, y1, isWhite);
+    BMP_L1_STATS_END(BMP_L1_API_DRAWRECT, pixels, pixels);
 }
 
 /**
@@ -436,7 +696,9 @@ void BMP_L1_fill(uint8_t *pbmp, uint8_t isWhite)
     if (pbmp == NULL)
         return;
 
-    BMP_L1_drawRect(pbmp, 0, 0, BMP_L1_getWidth(pbmp)-1, BMP_L1_getHeight(pbmp)-1, isWhite);
+    BMP_L1_STATS_BEGIN();
+    uint32_t pixels = BMP_L1_fillRect(pbmp, 0, 0, BMP_L1_getWidth(pbmp)-1, BMP_L1_getHeight(pbmp)-1, isWhite);
+    BMP_L1_STATS_END(BMP_L1_API_FILL, pixels, BMP_L1_getImageSize(pbmp));
 }
 
 
@@ -455,6 +717,7 @@ void BMP_L1_fill(uint8_t *pbmp, uint8_t isWhite)
     uint32_t x_start, uint32_t y_start, 
     uint8_t isWhite)
 {
+    BMP_L1_STATS_BEGIN();
     size_t len = strlen(text);
     int16_t imgWidth   = BMP_L1_getWidth(pbmp);
     int16_t imgHeight  = BMP_L1_getHeight(pbmp);
@@ -471,7 +734,7 @@ void BMP_L1_fill(uint8_t *pbmp, uint8_t isWhite)
         {
             y = y_start + yTxt;
             if(y >= imgHeight)
-                return;
+                break;
             for(int16_t xTxt = 0; xTxt < font.char_width; xTxt++)
             {
                 x = x_start + i * font.char_width + xTxt;
@@ -482,10 +745,12 @@ void BMP_L1_fill(uint8_t *pbmp, uint8_t isWhite)
                             + yTxt * bytesPerChar
                             + (bytesPerChar - 1) - (xTxt >> 3));
                 if(buf & (0x80 >> (xTxt & 0x07)))
-                    BMP_L1_setPixel(pbmp, x, y, isWhite);
+                    BMP_L1_putPixel(pbmp, x, y, isWhite);
             }
         }
     }
+    BMP_L1_STATS_END(BMP_L1_API_DRAWTEXT, (uint64_t)len * font.char_width * font.char_height,
+                     (uint64_t)len * font.char_height * bytesPerChar);
 }
 
 
@@ -497,10 +762,16 @@ void BMP_L1_fill(uint8_t *pbmp, uint8_t isWhite)
   */
 uint8_t *BMP_L1_copy(uint8_t *pbmp)
 {
-    uint8_t *pbmpDst = BMP_L1_create(BMP_L1_getWidth(pbmp), BMP_L1_getHeight(pbmp));
-    if(pbmpDst == NULL)
-        return NULL;
-    memcpy(pbmpDst, pbmp, BMP_L1_getFileSize(pbmp));
+    BMP_L1_STATS_BEGIN();
+    uint32_t size = 0;
+    uint8_t *pbmpDst = BMP_L1_createImage(BMP_L1_getWidth(pbmp), BMP_L1_getHeight(pbmp), BMP_L1_BOTTOM_UP);
+    if(pbmpDst != NULL)
+    {
+        size = BMP_L1_getFileSize(pbmp);
+        memcpy(pbmpDst, pbmp, size);    // including the header, so the layout is kept
+    }
+    BMP_L1_STATS_END(BMP_L1_API_COPY, size ? (uint64_t)BMP_L1_getWidth(pbmp) * BMP_L1_getHeight(pbmp) : 0,
+                     2 * (uint64_t)size);
     return pbmpDst;
 }
 
@@ -523,7 +794,8 @@ uint8_t *BMP_L1_resize_bicubic(uint8_t *pbmpSrc, uint32_t width, uint32_t height
 	float dx, dy;
 	float tx, ty;
 
-	pbmpDst = BMP_L1_create(width, height);
+	BMP_L1_STATS_BEGIN();
+	pbmpDst = BMP_L1_createImage(width, height, BMP_L1_BOTTOM_UP);
 	if(pbmpDst == NULL)
 		return NULL;
 
@@ -553,19 +825,19 @@ uint8_t *BMP_L1_resize_bicubic(uint8_t *pbmpSrc, uint32_t width, uint32_t height
 				for (int j = 0; j <= 3; j++)
 				{
                     uint8_t buf1, buf2;
-					BMP_L1_getPixel(pbmpSrc, RANGE((x - 1) + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf1);
-					BMP_L1_getPixel(pbmpSrc, RANGE((x)     + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf2);
+					BMP_L1_peekPixel(pbmpSrc, RANGE((x - 1) + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf1);
+					BMP_L1_peekPixel(pbmpSrc, RANGE((x)     + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf2);
 					d0 = buf1 - buf2;
 
-					BMP_L1_getPixel(pbmpSrc, RANGE((x + 1) + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf1);
-					BMP_L1_getPixel(pbmpSrc, RANGE((x)     + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf2);
+					BMP_L1_peekPixel(pbmpSrc, RANGE((x + 1) + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf1);
+					BMP_L1_peekPixel(pbmpSrc, RANGE((x)     + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf2);
                     d2 = buf1 - buf2;
 
-					BMP_L1_getPixel(pbmpSrc, RANGE((x + 2) + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf1);
-					BMP_L1_getPixel(pbmpSrc, RANGE((x)     + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf2);
+					BMP_L1_peekPixel(pbmpSrc, RANGE((x + 2) + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf1);
+					BMP_L1_peekPixel(pbmpSrc, RANGE((x)     + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf2);
 					d3 = buf1 - buf2;
 
-					BMP_L1_getPixel(pbmpSrc, RANGE((x)     + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf1);
+					BMP_L1_peekPixel(pbmpSrc, RANGE((x)     + i, 0, src_x_size-1), RANGE(y - 1 + j, 0, src_y_size-1), &buf1);
                     a0 = buf1;
 
                     a1 = -1.0f / 3 * d0 +            d2 - 1.0f / 6 * d3;
@@ -581,23 +853,2173 @@ uint8_t *BMP_L1_resize_bicubic(uint8_t *pbmpSrc, uint32_t width, uint32_t height
                     a2 =  1.0f / 2 * d0 + 1.0f / 2 * d2;
                     a3 = -1.0f / 6 * d0 - 1.0f / 2 * d2 + 1.0f / 6 * d3;
 
-					BMP_L1_setPixel(pbmpDst, dstRow + i, dstCol, 
+					BMP_L1_putPixel(pbmpDst, dstRow + i, dstCol, 
                         (a0 + a1 * dy + a2 * dy * dy + a3 * dy * dy * dy) > 0.5f ? BMP_L1_WHITE : BMP_L1_BLACK);
 				}
 			}
 		}
 	}
+	BMP_L1_STATS_END(BMP_L1_API_RESIZE_BICUBIC, (uint64_t)width * height,
+	                 BMP_L1_getImageSize(pbmpDst) + BMP_L1_getImageSize(pbmpSrc));
 	return pbmpDst;
 }
 
+/**
+  * @brief  Nearest Neighbor Interpolation.
+  * @param  pbmpSrc pointer to a source image
+  * @param  width width of interpolated image [pixel]
+  * @param  height height of interpolated image [pixel]
+  * @retval pointer to the created image. When error, return NULL.
+  * @detail Edges stay sharp, so this suits icons and QR codes.
+  *         Source columns are looked up in a precomputed map, and repeated source rows are copied.
+  *         When width is 1 to 8 times the source width, each source byte is expanded through a
+  *         lookup table instead, so an integer upscale is mostly memcpy.
+  */
+uint8_t *BMP_L1_resize_nearest(uint8_t *pbmpSrc, uint32_t width, uint32_t height)
+{
+    uint8_t *pbmpDst, *table;
+    uint32_t src_width, src_height, factor = 0, size;
+
+    if (pbmpSrc == NULL || width == 0 || height == 0)
+        return NULL;
+    src_width  = BMP_L1_getWidth (pbmpSrc);
+    src_height = BMP_L1_getHeight(pbmpSrc);
+    if (src_width == 0 || src_height == 0)
+        return NULL;
+    if (width % src_width == 0 && width / src_width <= 8)
+        factor = width / src_width;
 
-/* Private functions ---------------------------------------------------------*/
+    BMP_L1_STATS_BEGIN();
+    pbmpDst = BMP_L1_createImage(width, height, BMP_L1_BOTTOM_UP);
+    if (pbmpDst == NULL)
+        return NULL;
+
+    // Byte expansion table, or source x of each column
+    size = factor ? 256 * factor : sizeof(uint32_t) * width;
+    table = (uint8_t *)BMP_L1_allocMem(size);
+    if (table == NULL)
+    {
+        BMP_L1_freeImage(pbmpDst);
+        return NULL;
+    }
+    uint32_t *xmap = (uint32_t *)table;
+    if (factor)
+        BMP_L1_spreadTable(table, factor);
+    else
+        for (uint32_t x = 0; x < width; x++)
+            xmap[x] = (uint32_t)(((2 * (uint64_t)x + 1) * src_width) / (2 * (uint64_t)width));
+
+    uint32_t bytes = (width + 7) >> 3;
+    uint8_t *pPrev = NULL;
+    uint32_t src_y_prev = 0;
+    for (uint32_t y = 0; y < height; y++)
+    {
+        uint32_t src_y = (uint32_t)(((2 * (uint64_t)y + 1) * src_height) / (2 * (uint64_t)height));
+        uint8_t *pRow = BMP_L1_getRow(pbmpDst, y);
+        const uint8_t *pSrc = BMP_L1_getRow(pbmpSrc, src_y);
+
+        if (pPrev != NULL && src_y == src_y_prev)
+        {
+            memcpy(pRow, pPrev, bytes);
+        }
+        else if (factor)
+        {
+            BMP_L1_spreadRow(pRow, pSrc, table, factor, width);
+        }
+        else
+        {
+            uint32_t acc = 0;
+            for (uint32_t x = 0; x < width; x++)
+            {
+                uint32_t src_x = xmap[x];
+                acc = (acc << 1) | ((pSrc[src_x >> 3] >> (7 - (src_x & 0x07))) & 0x01);
+                if ((x & 0x07) == 0x07)
+                {
+                    pRow[x >> 3] = (uint8_t)acc;
+                    acc = 0;
+                }
+            }
+            if (width & 0x07)
+                pRow[width >> 3] = (uint8_t)(acc << (8 - (width & 0x07)));
+        }
+        pPrev = pRow;
+        src_y_prev = src_y;
+    }
+
+    BMP_L1_freeMem(table);
+    BMP_L1_STATS_END(BMP_L1_API_RESIZE_NEAREST, (uint64_t)width * height,
+                     BMP_L1_getImageSize(pbmpDst) + BMP_L1_getImageSize(pbmpSrc));
+    return pbmpDst;
+}
+
+/**
+  * @brief  Affine transform (rotation, skew, scaling, translation).
+  * @param  pbmpSrc pointer to a source image
+  * @param  matrix {a, b, c, d, e, f}: source point (x, y) is mapped to (a*x + b*y + c, d*x + e*y + f).
+  *         Pixel (x, y) covers [x, x+1) x [y, y+1).
+  * @param  width width of transformed image [pixel]
+  * @param  height height of transformed image [pixel]
+  * @param  mode BMP_L1_WARP_NEAREST: nearest neighbor,
+  *              BMP_L1_WARP_AREA: majority of 4x4 samples over the pixel area (smoother edges)
+  * @retval pointer to the created image. When error (e.g. the matrix is not invertible), return NULL.
+  * @detail Pixels mapped outside of the source image are white.
+  *         The inverse matrix is stepped in 16.16 fixed point along each row, and only the span
+  *         of the row that hits the source is sampled. Source size must be less than 16384 pixels,
+  *         and transformed size 1 to 32767 pixels.
+  */
+uint8_t *BMP_L1_warpAffine(uint8_t *pbmpSrc, const float *matrix, uint32_t width, uint32_t height, uint8_t mode)
+{
+    double det, inv[6];
+    int32_t su[BMP_L1_WARP_AREA_N * BMP_L1_WARP_AREA_N] = {0}, sv[BMP_L1_WARP_AREA_N * BMP_L1_WARP_AREA_N] = {0};
+    int32_t su_min = 0, su_max = 0, sv_min = 0, sv_max = 0;
+    uint32_t samples = 1;
+
+    if (pbmpSrc == NULL || matrix == NULL || width == 0 || height == 0 || width >= 0x8000 || height >= 0x8000
+        || (mode != BMP_L1_WARP_NEAREST && mode != BMP_L1_WARP_AREA))
+        return NULL;
+    uint32_t src_width  = BMP_L1_getWidth(pbmpSrc);
+    uint32_t src_height = BMP_L1_getHeight(pbmpSrc);
+    if (src_width >= 0x4000 || src_height >= 0x4000)
+        return NULL;
+
+    // Destination to source
+    det = (double)matrix[0] * matrix[4] - (double)matrix[1] * matrix[3];
+    if (det == 0.0)
+        return NULL;
+    inv[0] =  matrix[4] / det;
+    inv[1] = -matrix[1] / det;
+    inv[3] = -matrix[3] / det;
+    inv[4] =  matrix[0] / det;
+    inv[2] = -(inv[0] * matrix[2] + inv[1] * matrix[5]);
+    inv[5] = -(inv[3] * matrix[2] + inv[4] * matrix[5]);
+    for (int i = 0; i < 6; i++)
+    {
+        double limit = (i == 2 || i == 5) ? 16777216.0 : 4096.0;
+        if (!(inv[i] > -limit && inv[i] < limit))
+            return NULL;
+    }
+
+    BMP_L1_STATS_BEGIN();
+    uint8_t *pbmpDst = BMP_L1_createImage(width, height, BMP_L1_BOTTOM_UP);
+    if (pbmpDst == NULL)
+        return NULL;
+
+    // Sample offsets from the pixel center, and their extent
+    if (mode == BMP_L1_WARP_AREA)
+    {
+        samples = BMP_L1_WARP_AREA_N * BMP_L1_WARP_AREA_N;
+        for (uint32_t i = 0; i < samples; i++)
+        {
+            double ox = ((i % BMP_L1_WARP_AREA_N) + 0.5) / BMP_L1_WARP_AREA_N - 0.5;
+            double oy = ((i / BMP_L1_WARP_AREA_N) + 0.5) / BMP_L1_WARP_AREA_N - 0.5;
+            su[i] = (int32_t)BMP_L1_FIXED(inv[0] * ox + inv[1] * oy);
+            sv[i] = (int32_t)BMP_L1_FIXED(inv[3] * ox + inv[4] * oy);
+            su_min = su[i] < su_min ? su[i] : su_min;
+            su_max = su[i] > su_max ? su[i] : su_max;
+            sv_min = sv[i] < sv_min ? sv[i] : sv_min;
+            sv_max = sv[i] > sv_max ? sv[i] : sv_max;
+        }
+    }
+
+    const uint8_t *pSrc = BMP_L1_getRow(pbmpSrc, 0);
+    int32_t pitch = BMP_L1_getPitch(pbmpSrc);
+    int64_t u_end = (int64_t)src_width  << 16;
+    int64_t v_end = (int64_t)src_height << 16;
+    int32_t du = (int32_t)BMP_L1_FIXED(inv[0]);
+    int32_t dv = (int32_t)BMP_L1_FIXED(inv[3]);
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        uint8_t *pRow = BMP_L1_getRow(pbmpDst, y);
+        BMP_L1_fillSpan(pRow, 0, width - 1, BMP_L1_WHITE);
+
+        // Source coordinates of the center of pixel (x, y) are (u0 + du * x, v0 + dv * x)
+        int64_t u0 = BMP_L1_FIXED(inv[0] * 0.5 + inv[1] * (y + 0.5) + inv[2]);
+        int64_t v0 = BMP_L1_FIXED(inv[3] * 0.5 + inv[4] * (y + 0.5) + inv[5]);
+
+        // [x0, x1]: some sample may hit the source, [xi0, xi1]: all samples hit the source
+        int32_t x0 = 0, x1 = (int32_t)width - 1;
+        BMP_L1_warpClip(u0, du, -su_max, u_end - su_min, &x0, &x1);
+        BMP_L1_warpClip(v0, dv, -sv_max, v_end - sv_min, &x0, &x1);
+        if (x0 > x1)
+            continue;
+        int32_t xi0 = x0, xi1 = x1;
+        BMP_L1_warpClip(u0, du, -su_min, u_end - su_max, &xi0, &xi1);
+        BMP_L1_warpClip(v0, dv, -sv_min, v_end - sv_max, &xi0, &xi1);
+
+        int32_t u = (int32_t)(u0 + (int64_t)du * x0);
+        int32_t v = (int32_t)(v0 + (int64_t)dv * x0);
+        uint8_t *pBuf = pRow + (x0 >> 3);
+        uint32_t bits = x0 & 0x07;
+        uint32_t acc = (uint32_t)*pBuf >> (8 - bits);
+        for (int32_t x = x0; x <= x1; x++, u += du, v += dv)
+        {
+            uint32_t pixel;
+            if (mode == BMP_L1_WARP_NEAREST)
+            {
+                pixel = BMP_L1_warpSample(pSrc, pitch, u, v);
+            }
+            else
+            {
+                uint32_t white = 0;
+                if (x >= xi0 && x <= xi1)
+                {
+                    for (uint32_t i = 0; i < samples; i++)
+                        white += BMP_L1_warpSample(pSrc, pitch, u + su[i], v + sv[i]);
+                }
+                else
+                {
+                    for (uint32_t i = 0; i < samples; i++)
+                    {
+                        int32_t us = u + su[i], vs = v + sv[i];
+                        if (us < 0 || vs < 0 || us >= u_end || vs >= v_end)
+                            white++;
+                        else
+                            white += BMP_L1_warpSample(pSrc, pitch, us, vs);
+                    }
+                }
+                pixel = white * 2 > samples;
+            }
+
+            // Pack 8 pixels before writing
+            acc = (acc << 1) | pixel;
+            if (++bits == 8)
+            {
+                *pBuf++ = (uint8_t)acc;
+                acc = 0;
+                bits = 0;
+            }
+        }
+        if (bits)
+            *pBuf = (uint8_t)((acc << (8 - bits)) | (*pBuf & (0xFF >> bits)));
+    }
+
+    BMP_L1_STATS_END(BMP_L1_API_WARP_AFFINE, (uint64_t)width * height * samples,
+                     BMP_L1_getImageSize(pbmpDst) + BMP_L1_getImageSize(pbmpSrc));
+    return pbmpDst;
+}
+
+/**
+  * @brief  Copy a source image onto a destination image.
+  * @param  pbmpDst pointer to a destination image
+  * @param  pbmpSrc pointer to a source image
+  * @param  x	x of the top-left corner of the source on the destination [pixel]
+  * @param  y	y of the top-left corner of the source on the destination [pixel]
+  * @retval None
+  * @detail Both colors are copied. Parts outside the destination are clipped.
+  */
+void BMP_L1_blit(uint8_t *pbmpDst, uint8_t *pbmpSrc, int32_t x, int32_t y)
+{
+    BMP_L1_STATS_BEGIN();
+    uint32_t pixels = BMP_L1_blitImage(pbmpDst, pbmpSrc, x, y);
+    BMP_L1_STATS_END(BMP_L1_API_BLIT, pixels, pixels >> 2);
+}
+
+
+/**
+  * @brief  Compare two images.
+  * @param  pbmpA pointer to an image
+  * @param  pbmpB pointer to an image
+  * @retval 1: same size and pixels, 0: otherwise
+  * @detail Rows are compared a machine word at a time, returning at the first
+  *         differing word. Row padding bits are ignored.
+  */
+uint8_t BMP_L1_equal(uint8_t *pbmpA, uint8_t *pbmpB)
+{
+    uint32_t width, height;
+    uint8_t ret = 1;
+
+    if (pbmpA == NULL || pbmpB == NULL)
+        return 0;
+    width  = BMP_L1_getWidth(pbmpA);
+    height = BMP_L1_getHeight(pbmpA);
+    if (width != BMP_L1_getWidth(pbmpB) || height != BMP_L1_getHeight(pbmpB))
+        return 0;
+
+    BMP_L1_STATS_BEGIN();
+
+    uint32_t y;
+    for (y = 0; y < height; y++)
+    {
+        if (!BMP_L1_rowsEqual(BMP_L1_getRow(pbmpA, y), BMP_L1_getRow(pbmpB, y), width))
+        {
+            ret = 0;
+            break;
+        }
+    }
+    BMP_L1_STATS_END(BMP_L1_API_EQUAL, (uint64_t)width * y, 2 * (uint64_t)((width + 7) >> 3) * y);
+    return ret;
+}
+
+/**
+  * @brief  Create a delta patch turning one image into another.
+  * @param  pbmpA pointer to the old image
+  * @param  pbmpB pointer to the new image (same size as pbmpA)
+  * @retval pointer to the created patch. When error (different sizes, out of memory), return NULL.
+  *         Free it with BMP_L1_free(); its size is BMP_L1_getPatchSize().
+  * @detail Only the changed row ranges are stored, as run-length coded XOR bytes,
+  *         so the same patch turns pbmpB back into pbmpA.
+  *         Layout (multi-byte values are little-endian):
+  *           0x00 'L','1','D','P'  magic
+  *           0x04 uint32 patch size [byte]
+  *           0x08 uint32 width  [pixel]
+  *           0x0C uint32 height [pixel]
+  *           0x10 uint32 number of ranges
+  *           0x14 ranges: uint32 first row (0 = top), uint32 number of rows, then the XOR
+  *                of those rows (ceil(width/8) bytes per row, concatenated) coded as
+  *                control byte c < 0x80: c+1 literal bytes follow,
+  *                control byte c >= 0x80: the next byte repeats (c - 0x80) + 3 times.
+  */
+uint8_t *BMP_L1_diff(uint8_t *pbmpA, uint8_t *pbmpB)
+{
+    uint8_t *patch;
+    uint32_t size;
+
+    if (pbmpA == NULL || pbmpB == NULL)
+        return NULL;
+    if (BMP_L1_getWidth(pbmpA) != BMP_L1_getWidth(pbmpB) || BMP_L1_getHeight(pbmpA) != BMP_L1_getHeight(pbmpB))
+        return NULL;
+
+    // First pass measures, second pass writes
+    BMP_L1_STATS_BEGIN();
+    size = BMP_L1_diff_encode(pbmpA, pbmpB, NULL);
+    patch = (uint8_t *)BMP_L1_allocMem(size);
+    if (patch != NULL)
+        BMP_L1_diff_encode(pbmpA, pbmpB, patch);
+
+    BMP_L1_STATS_END(BMP_L1_API_DIFF, 2 * (uint64_t)BMP_L1_getWidth(pbmpA) * BMP_L1_getHeight(pbmpA),
+                     4 * (uint64_t)BMP_L1_getImageSize(pbmpA) + size);
+    return patch;
+}
+
+/**
+  * @brief  Get size of a patch.
+  * @param  patch pointer to a patch created by BMP_L1_diff()
+  * @retval patch size [byte]
+  */
+uint32_t BMP_L1_getPatchSize(uint8_t *patch)
+{
+    return BMP_L1_read_uint32_t(patch + 0x04);
+}
+
+/**
+  * @brief  Apply a patch created by BMP_L1_diff() to an image in place.
+  * @param  pbmp pointer to an image
+  * @param  patch pointer to a patch
+  * @param  patch_len number of bytes available at patch
+  * @retval 0: success, -1: error (malformed or truncated patch, or size mismatch; the image may be partly patched)
+  * @detail Uses no memory besides the image, and touches only the changed rows.
+  *         Nothing beyond patch_len bytes is read, whatever the patch header says.
+  */
+int BMP_L1_applyPatch(uint8_t *pbmp, uint8_t *patch, uint32_t patch_len)
+{
+    uint32_t width, height, size, ranges;
+    uint64_t rows_touched = 0;
+    int ret;
+
+    if (pbmp == NULL || patch == NULL || patch_len < BMP_L1_PATCH_HEADER_SIZE)
+        return -1;
+    if (patch[0] != 'L' || patch[1] != '1' || patch[2] != 'D' || patch[3] != 'P')
+        return -1;
+
+    size   = BMP_L1_read_uint32_t(patch + 0x04);
+    width  = BMP_L1_read_uint32_t(patch + 0x08);
+    height = BMP_L1_read_uint32_t(patch + 0x0C);
+    ranges = BMP_L1_read_uint32_t(patch + 0x10);
+    if (size < BMP_L1_PATCH_HEADER_SIZE || size > patch_len
+        || width != BMP_L1_getWidth(pbmp) || height != BMP_L1_getHeight(pbmp))
+        return -1;
+
+    BMP_L1_STATS_BEGIN();
+    ret = BMP_L1_diff_decode(pbmp, patch + BMP_L1_PATCH_HEADER_SIZE, patch + size, ranges, &rows_touched);
+    BMP_L1_STATS_END(BMP_L1_API_APPLY_PATCH, rows_touched * width, rows_touched * ((width + 7) >> 3) + size);
+    return ret;
+}
+
+/**
+  * @brief  Encode an image as binary PBM (P4).
+  * @param  pbmp pointer to an image
+  * @param  write function receiving the encoded bytes
+  * @param  ctx user pointer passed to write
+  * @retval 0: success, -1: error (aborted by write)
+  * @detail Rows are read straight from the pixel area, inverted (PBM: 1 = black)
+  *         and passed on through a fixed buffer of BMP_L1_ENCODE_BUFFER_SIZE bytes.
+  */
+int BMP_L1_writePBM(uint8_t *pbmp, BMP_L1_write_Function write, void *ctx)
+{
+    uint8_t buf[BMP_L1_ENCODE_BUFFER_SIZE];
+    uint32_t width, height, bytes, n;
+    uint8_t tail;
+    int ret = 0;
+
+    if (pbmp == NULL || write == NULL)
+        return -1;
+
+    BMP_L1_STATS_BEGIN();
+    width  = BMP_L1_getWidth(pbmp);
+    height = BMP_L1_getHeight(pbmp);
+    bytes  = (width + 7) >> 3;
+    tail   = (width & 0x07) ? (uint8_t)(0xFF << (8 - (width & 0x07))) : 0xFF;
+
+    n = (uint32_t)snprintf((char *)buf, sizeof(buf), "P4\n%lu %lu\n", (unsigned long)width, (unsigned long)height);
+    for (uint32_t y = 0; y < height && ret == 0; y++)
+    {
+        const uint8_t *pRow = BMP_L1_getRow(pbmp, y);
+        for (uint32_t i = 0; i < bytes && ret == 0; i++)
+        {
+            if (n == sizeof(buf))
+            {
+                ret = write(ctx, buf, n) != 0 ? -1 : 0;
+                n = 0;
+            }
+            buf[n++] = (uint8_t)~pRow[i];
+        }
+        buf[n - 1] &= tail;
+    }
+    if (ret == 0 && n > 0 && write(ctx, buf, n) != 0)
+        ret = -1;
+
+    BMP_L1_STATS_END(BMP_L1_API_WRITE_PBM, (uint64_t)width * height, 2 * (uint64_t)bytes * height);
+    return ret;
+}
+
+/**
+  * @brief  Encode an image as 1-bit grayscale PNG.
+  * @param  pbmp pointer to an image
+  * @param  write function receiving the encoded bytes
+  * @param  ctx user pointer passed to write
+  * @retval 0: success, -1: error (out of memory or aborted by write)
+  * @detail Self-contained deflate (LZ77 with fixed Huffman codes), no external library.
+  *         A block that would not shrink is written as stored data instead, so noisy images
+  *         grow by only a few bytes per block over their raw size.
+  *         Rows are read straight from the pixel area. Each row uses filter None or Up,
+  *         whichever yields fewer byte transitions, which suits bilevel content.
+  *         Working memory is about 2^BMP_L1_PNG_WINDOW_BITS + 4 * 2^BMP_L1_PNG_HASH_BITS
+  *         + 2 * BMP_L1_PNG_BLOCK_SYMBOLS + BMP_L1_PNG_IDAT_SIZE bytes, allocated once,
+  *         whatever the image size.
+  */
+int BMP_L1_writePNG(uint8_t *pbmp, BMP_L1_write_Function write, void *ctx)
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    BMP_L1_png_st *st;
+    uint8_t ihdr[13];
+    uint32_t width, height, bytes;
+    uint8_t tail;
+    int ret;
+
+    if (pbmp == NULL || write == NULL)
+        return -1;
+
+    BMP_L1_STATS_BEGIN();
+    width  = BMP_L1_getWidth(pbmp);
+    height = BMP_L1_getHeight(pbmp);
+    bytes  = (width + 7) >> 3;
+    tail   = (width & 0x07) ? (uint8_t)(0xFF << (8 - (width & 0x07))) : 0xFF;
+
+    st = (BMP_L1_png_st *)BMP_L1_allocMem(sizeof(BMP_L1_png_st));
+    if (st == NULL)
+        return -1;
+    memset(st->head, 0, sizeof(st->head));
+    st->write    = write;
+    st->ctx      = ctx;
+    st->status   = 0;
+    st->pos_in   = 0;
+    st->pos_cur  = 0;
+    st->pos_block  = 0;
+    st->nsym       = 0;
+    st->block_bits = 0;
+    st->bitbuf   = 0;
+    st->bitcount = 0;
+    st->adler_a  = 1;
+    st->adler_b  = 0;
+    st->nout     = 0;
+
+    if (write(ctx, signature, sizeof(signature)) != 0)
+        st->status = -1;
+
+    // IHDR: width, height, bit depth 1, grayscale, deflate, adaptive filtering, no interlace.
+    // Grayscale 0 is black and 1 is white, the same as the BMP palette, so bits are copied as is.
+    BMP_L1_write_uint32_t_be(width,  ihdr + 0);
+    BMP_L1_write_uint32_t_be(height, ihdr + 4);
+    ihdr[8]  = 1;
+    ihdr[9]  = 0;
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+    BMP_L1_png_chunk(st, "IHDR", ihdr, sizeof(ihdr));
+
+    // zlib header: deflate, window size, no dictionary, FCHECK
+    uint32_t cmf = 0x08 | ((BMP_L1_PNG_WINDOW_BITS - 8) << 4);
+    BMP_L1_png_byte(st, (uint8_t)cmf);
+    BMP_L1_png_byte(st, (uint8_t)((31 - ((cmf << 8) % 31)) % 31));
+
+    for (uint32_t y = 0; y < height && st->status == 0; y++)
+    {
+        const uint8_t *pRow  = BMP_L1_getRow(pbmp, y);
+        const uint8_t *pPrev = y > 0 ? BMP_L1_getRow(pbmp, y - 1) : NULL;
+
+        // Count byte transitions of both candidate filters; runs are what LZ77 compresses best
+        uint8_t filter = 0;
+        if (pPrev != NULL)
+        {
+            uint32_t none = 0, up = 0;
+            uint8_t lastNone = 0, lastUp = 0;
+            for (uint32_t i = 0; i < bytes; i++)
+            {
+                uint8_t m = i + 1 < bytes ? 0xFF : tail;
+                uint8_t vNone = pRow[i] & m;
+                uint8_t vUp   = (uint8_t)(vNone - (pPrev[i] & m));
+                none += (vNone != lastNone);
+                up   += (vUp   != lastUp);
+                lastNone = vNone;
+                lastUp   = vUp;
+            }
+            if (up < none)
+                filter = 2;
+        }
+
+        BMP_L1_png_feed(st, filter);
+        for (uint32_t i = 0; i < bytes; i++)
+        {
+            uint8_t m = i + 1 < bytes ? 0xFF : tail;
+            uint8_t v = pRow[i] & m;
+            if (filter == 2)
+                v = (uint8_t)(v - (pPrev[i] & m));
+            BMP_L1_png_feed(st, v);
+        }
+    }
+
+    // Encode the remaining lookahead, the final block, then the Adler-32 of the raw data
+    while (st->pos_cur < st->pos_in)
+        BMP_L1_png_step(st);
+    BMP_L1_png_block(st, 1);
+    if (st->bitcount > 0)
+        BMP_L1_png_bits(st, 0, 8 - st->bitcount);
+    BMP_L1_png_byte(st, (uint8_t)(st->adler_b >> 8));
+    BMP_L1_png_byte(st, (uint8_t)(st->adler_b));
+    BMP_L1_png_byte(st, (uint8_t)(st->adler_a >> 8));
+    BMP_L1_png_byte(st, (uint8_t)(st->adler_a));
+    if (st->nout > 0)
+        BMP_L1_png_chunk(st, "IDAT", st->out, st->nout);
+    BMP_L1_png_chunk(st, "IEND", NULL, 0);
+
+    ret = st->status;
+    BMP_L1_freeMem(st);
+    BMP_L1_STATS_END(BMP_L1_API_WRITE_PNG, (uint64_t)width * height, 2 * (uint64_t)bytes * height);
+    return ret;
+}
+
+/**
+  * @brief  Create an empty display list.
+  * @param  width width of the canvas [pixel]
+  * @param  height height of the canvas [pixel]
+  * @retval pointer to the created display list. When error, return NULL
+  * @detail Drawing commands are recorded with BMP_L1_dlist_*() and replayed
+  *         band by band with BMP_L1_dlist_render(), so the canvas never needs
+  *         to fit in memory. Like BMP_L1_create(), the canvas starts black.
+  */
+BMP_L1_dlist_st *BMP_L1_dlist_create(uint32_t width, uint32_t height)
+{
+    BMP_L1_dlist_st *dl;
+
+    if (width == 0 || height == 0)
+        return NULL;
+
+    dl = (BMP_L1_dlist_st *)BMP_L1_allocMem(sizeof(BMP_L1_dlist_st));
+    if (dl == NULL)
+        return NULL;
+
+    dl->width    = width;
+    dl->height   = height;
+    dl->buf      = NULL;
+    dl->size     = 0;
+    dl->capacity = 0;
+    return dl;
+}
+
+/**
+  * @brief  Free a display list.
+  * @param  dl pointer to a display list
+  * @retval None
+  */
+void BMP_L1_dlist_free(BMP_L1_dlist_st *dl)
+{
+    if (dl == NULL)
+        return;
+    BMP_L1_freeMem(dl->buf);
+    BMP_L1_freeMem(dl);
+}
+
+/**
+  * @brief  Record BMP_L1_drawLine().
+  * @param  dl pointer to a display list
+  * @param  x0	Start x position of a line(Range:[0,width-1] ) [pixel]
+  * @param  y0  Start y position of a line(Range:[0,height-1]) [pixel]
+  * @param  x1	End   x position of a line(Range:[0,width-1] ) [pixel]
+  * @param  y1  End   y position of a line(Range:[0,height-1]) [pixel]
+  * @param  isWhite White flag. 0: black, 1: white, otherwise: undefined
+  * @retval 0: success, -1: error (out of memory)
+  * @detail As with BMP_L1_drawLine(), a line with an end point out of range is ignored.
+  */
+int BMP_L1_dlist_drawLine(BMP_L1_dlist_st *dl,
+        int32_t x0, int32_t y0, int32_t x1, int32_t y1,
+        uint8_t isWhite)
+{
+    int32_t *p;
+
+    if (dl == NULL)
+        return -1;
+    if (x0 < 0 || x0 >= (int32_t)dl->width || x1 < 0 || x1 >= (int32_t)dl->width
+        || y0 < 0 || y0 >= (int32_t)dl->height || y1 < 0 || y1 >= (int32_t)dl->height)
+        return 0;
+
+    p = (int32_t *)BMP_L1_dlist_append(dl, BMP_L1_DL_LINE, isWhite, 4 * sizeof(int32_t),
+            x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0);
+    if (p == NULL)
+        return -1;
+    p[0] = x0;
+    p[1] = y0;
+    p[2] = x1;
+    p[3] = y1;
+    return 0;
+}
+
+/**
+  * @brief  Record BMP_L1_drawRect().
+  * @param  dl pointer to a display list
+  * @param  x0	Start x position of a rectangle(Range:[0,width-1] ) [pixel]
+  * @param  y0  Start y position of a rectangle(Range:[0,height-1]) [pixel]
+  * @param  x1	End   x position of a rectangle(Range:[0,width-1] ) [pixel]
+  * @param  y1  End   y position of a rectangle(Range:[0,height-1]) [pixel]
+  * @param  isWhite White flag. 0: black, 1: white, otherwise: undefined
+  * @retval 0: success, -1: error (out of memory)
+  * @detail As with BMP_L1_drawRect(), a rectangle with a corner out of range is ignored.
+  */
+int BMP_L1_dlist_drawRect(BMP_L1_dlist_st *dl,
+        uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
+        uint8_t isWhite)
+{
+    if (dl == NULL)
+        return -1;
+    if (x0 >= dl->width || x1 >= dl->width || y0 >= dl->height || y1 >= dl->height)
+        return 0;
+
+    if (BMP_L1_dlist_append(dl, BMP_L1_DL_RECT, isWhite, 0,
+            x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0) == NULL)
+        return -1;
+    return 0;
+}
+
+/**
+  * @brief  Record BMP_L1_fill().
+  * @param  dl pointer to a display list
+  * @param  isWhite White flag. 0: black, 1: white, otherwise: undefined
+  * @retval 0: success, -1: error (out of memory)
+  */
+int BMP_L1_dlist_fill(BMP_L1_dlist_st *dl, uint8_t isWhite)
+{
+    if (dl == NULL)
+        return -1;
+    return BMP_L1_dlist_drawRect(dl, 0, 0, dl->width - 1, dl->height - 1, isWhite);
+}
+
+/**
+  * @brief  Record BMP_L1_drawText().
+  * @param  dl pointer to a display list
+  * @param  text pointer to text to write. The text is copied.
+  * @param  font font
+  * @param  x_start	Start x position of characters (Range:[0,width-1] ) [pixel]
+  * @param  y_start Start y position of characters (Range:[0,height-1]) [pixel]
+  * @param  isWhite White flag. 0: black, 1: white, otherwise: undefined
+  * @retval 0: success, -1: error (out of memory)
+  */
+int BMP_L1_dlist_drawText(BMP_L1_dlist_st *dl, char *text, BMP_L1_font_st font,
+    uint32_t x_start, uint32_t y_start,
+    uint8_t isWhite)
+{
+    uint8_t *p;
+    uint32_t len;
+
+    if (dl == NULL || text == NULL)
+        return -1;
+    len = strlen(text);
+    if (len == 0 || x_start >= dl->width || y_start >= dl->height)
+        return 0;
+
+    p = (uint8_t *)BMP_L1_dlist_append(dl, BMP_L1_DL_TEXT, isWhite, sizeof(BMP_L1_font_st) + len + 1,
+            x_start, y_start,
+            x_start + len * font.char_width - 1, y_start + font.char_height - 1);
+    if (p == NULL)
+        return -1;
+    memcpy(p, &font, sizeof(BMP_L1_font_st));
+    memcpy(p + sizeof(BMP_L1_font_st), text, len + 1);
+    return 0;
+}
+
+/**
+  * @brief  Record BMP_L1_blit().
+  * @param  dl pointer to a display list
+  * @param  pbmpSrc pointer to a source image. It is not copied and must stay valid until rendered.
+  * @param  x	x of the top-left corner of the source on the canvas [pixel]
+  * @param  y	y of the top-left corner of the source on the canvas [pixel]
+  * @retval 0: success, -1: error (out of memory)
+  */
+int BMP_L1_dlist_blit(BMP_L1_dlist_st *dl, uint8_t *pbmpSrc, int32_t x, int32_t y)
+{
+    uint8_t **p;
+
+    if (dl == NULL || pbmpSrc == NULL)
+        return -1;
+
+    p = (uint8_t **)BMP_L1_dlist_append(dl, BMP_L1_DL_BLIT, 0, sizeof(uint8_t *),
+            x, y,
+            x + (int32_t)BMP_L1_getWidth(pbmpSrc) - 1, y + (int32_t)BMP_L1_getHeight(pbmpSrc) - 1);
+    if (p == NULL)
+        return -1;
+    *p = pbmpSrc;
+    return 0;
+}
+
+/**
+  * @brief  Render a display list band by band.
+  * @param  dl pointer to a display list
+  * @param  band_height number of rows per band [pixel]
+  * @param  sink function receiving each band in top to bottom order
+  * @param  ctx user pointer passed to sink
+  * @retval 0: success, -1: error (out of memory or aborted by sink)
+  * @detail Only one band image of width x band_height is allocated. It is top-down,
+  *         so its pixel area can be streamed as is.
+  *         Commands whose bounding box does not intersect a band are skipped.
+  *         The output is identical to drawing the same calls on a full image.
+  */
+int BMP_L1_dlist_render(BMP_L1_dlist_st *dl, uint32_t band_height, BMP_L1_band_Function sink, void *ctx)
+{
+    uint8_t *pband;
+    int ret = 0;
+
+    if (dl == NULL || sink == NULL || band_height == 0)
+        return -1;
+    if (band_height > dl->height)
+        band_height = dl->height;
+
+    BMP_L1_STATS_BEGIN();
+    pband = BMP_L1_createImage(dl->width, band_height, BMP_L1_TOP_DOWN);
+    if (pband == NULL)
+        return -1;
+
+    for (uint32_t y = 0; y < dl->height; y += band_height)
+    {
+        uint32_t rows = dl->height - y < band_height ? dl->height - y : band_height;
+        if (rows != BMP_L1_getHeight(pband))
+            BMP_L1_setHeight(pband, rows);
+        BMP_L1_dlist_renderBand(dl, pband, y);
+        if (sink(ctx, pband, y) != 0)
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    BMP_L1_freeImage(pband);
+    BMP_L1_STATS_END(BMP_L1_API_DLIST_RENDER, (uint64_t)dl->width * dl->height,
+                     (uint64_t)BMP_L1_getBytesPerRow(dl->width) * dl->height);
+    return ret;
+}
+
+#ifdef BMP_L1_USE_PTHREAD
+/**
+  * @brief  Render a display list band by band on several threads.
+  * @param  dl pointer to a display list
+  * @param  band_height number of rows per band [pixel]
+  * @param  threads number of threads including the calling one (0 or 1: same as BMP_L1_dlist_render)
+  * @param  sink function receiving each band in top to bottom order
+  * @param  ctx user pointer passed to sink
+  * @retval 0: success, -1: error (out of memory or aborted by sink)
+  * @detail Each thread renders into its own band image. Bands are still handed
+  *         to sink one at a time and in order, but possibly from different threads.
+  *         Statistics of the worker threads are added to those of the calling thread.
+  *         The display list and the blit sources must not be modified meanwhile.
+  *         The allocation functions must be thread-safe.
+  */
+int BMP_L1_dlist_renderParallel(BMP_L1_dlist_st *dl, uint32_t band_height, uint32_t threads,
+        BMP_L1_band_Function sink, void *ctx)
+{
+    BMP_L1_bandjob_st job;
+    pthread_t *tid;
+    uint32_t started = 0;
+
+    if (dl == NULL || sink == NULL || band_height == 0)
+        return -1;
+    if (band_height > dl->height)
+        band_height = dl->height;
+
+    job.dl          = dl;
+    job.band_height = band_height;
+    job.band_num    = (dl->height + band_height - 1) / band_height;
+    job.sink        = sink;
+    job.ctx         = ctx;
+    job.next_band   = 0;
+    job.next_emit   = 0;
+    job.status      = 0;
+#ifdef BMP_L1_ENABLE_STATS
+    memset(&job.stats, 0, sizeof(job.stats));
+#endif
+    if (threads > job.band_num)
+        threads = job.band_num;
+    if (threads <= 1)
+        return BMP_L1_dlist_render(dl, band_height, sink, ctx);
+
+    BMP_L1_STATS_BEGIN();
+    tid = (pthread_t *)BMP_L1_allocMem(sizeof(pthread_t) * (threads - 1));
+    if (tid == NULL)
+        return -1;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.cond, NULL);
+
+    // The calling thread is a worker too, so failing to start threads only reduces parallelism.
+    for (uint32_t i = 0; i < threads - 1; i++)
+    {
+        if (pthread_create(&tid[started], NULL, BMP_L1_dlist_thread, &job) == 0)
+            started++;
+    }
+    BMP_L1_dlist_worker(&job);
+    for (uint32_t i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+#ifdef BMP_L1_ENABLE_STATS
+    BMP_L1_stats_sum(&bmp_l1_stats, &job.stats);
+#endif
+
+    pthread_cond_destroy(&job.cond);
+    pthread_mutex_destroy(&job.lock);
+    BMP_L1_freeMem(tid);
+    BMP_L1_STATS_END(BMP_L1_API_DLIST_RENDER, (uint64_t)dl->width * dl->height,
+                     (uint64_t)BMP_L1_getBytesPerRow(dl->width) * dl->height);
+    return job.status;
+}
+
+/**
+  * @brief  Render many independent images on several threads.
+  * @param  jobs array of jobs
+  * @param  count number of jobs
+  * @param  batch options (threads, result function, per-worker initialization)
+  * @retval 0: success, -1: error (a job failed, out of memory or aborted by the result function)
+  * @detail Workers claim jobs in submission order from a shared cursor and render
+  *         into images taken from their own pool, allocated in the worker's allocator
+  *         context (see BMP_L1_setThreadAllocFunc()). Results are handed to
+  *         batch->result one at a time and in submission order, by whichever worker
+  *         completes the oldest pending job, after which the image returns to its pool.
+  *         Once every worker is done, each frees its own pool on its own thread.
+  *         The calling thread is worker 0. The result function may be called from any worker.
+  */
+int BMP_L1_renderBatch(const BMP_L1_job_st *jobs, uint32_t count, const BMP_L1_batch_st *batch)
+{
+    BMP_L1_batchjob_st job;
+    BMP_L1_batchworker_st *workers;
+    pthread_t *tid;
+    uint32_t threads, started = 0;
+    int ret;
+
+    if (jobs == NULL || batch == NULL || batch->result == NULL)
+        return -1;
+    if (count == 0)
+        return 0;
+
+    threads = batch->threads == 0 ? 1 : batch->threads;
+    if (threads > count)
+        threads = count;
+
+    BMP_L1_STATS_BEGIN();
+    job.jobs      = jobs;
+    job.count     = count;
+    job.batch     = batch;
+    job.lookahead = BMP_L1_BATCH_LOOKAHEAD * threads;
+    job.slots     = (BMP_L1_batch_slot_st *)BMP_L1_allocMem(sizeof(BMP_L1_batch_slot_st) * count);
+    job.pools     = (BMP_L1_pool_st *)BMP_L1_allocMem(sizeof(BMP_L1_pool_st) * threads);
+    workers       = (BMP_L1_batchworker_st *)BMP_L1_allocMem(sizeof(BMP_L1_batchworker_st) * threads);
+    tid           = (pthread_t *)BMP_L1_allocMem(sizeof(pthread_t) * threads);
+    if (job.slots == NULL || job.pools == NULL || workers == NULL || tid == NULL)
+    {
+        BMP_L1_freeMem(job.slots);
+        BMP_L1_freeMem(job.pools);
+        BMP_L1_freeMem(workers);
+        BMP_L1_freeMem(tid);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        job.slots[i].image = NULL;
+        atomic_init(&job.slots[i].done, 0);
+    }
+    for (uint32_t i = 0; i < threads; i++)
+    {
+        job.pools[i].head = NULL;
+        workers[i].job    = &job;
+        workers[i].worker = i;
+    }
+    atomic_init(&job.next_job, 0);
+    atomic_init(&job.next_emit, 0);
+    atomic_init(&job.status, 0);
+    atomic_init(&job.aborted, 0);
+    atomic_init(&job.emit_pending, 0);
+    job.active = threads;
+#ifdef BMP_L1_ENABLE_STATS
+    memset(&job.stats, 0, sizeof(job.stats));
+#endif
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.cond, NULL);
+
+    // The calling thread is worker 0, so failing to start threads only reduces parallelism.
+    for (uint32_t i = 1; i < threads; i++)
+    {
+        if (pthread_create(&tid[started], NULL, BMP_L1_batch_thread, &workers[i]) == 0)
+        {
+            started++;
+            continue;
+        }
+        pthread_mutex_lock(&job.lock);
+        job.active--;
+        pthread_mutex_unlock(&job.lock);
+    }
+    BMP_L1_batch_worker(&workers[0]);
+    for (uint32_t i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+#ifdef BMP_L1_ENABLE_STATS
+    BMP_L1_stats_sum(&bmp_l1_stats, &job.stats);
+#endif
+
+    ret = atomic_load(&job.status);
+    pthread_cond_destroy(&job.cond);
+    pthread_mutex_destroy(&job.lock);
+    BMP_L1_freeMem(job.slots);
+    BMP_L1_freeMem(job.pools);
+    BMP_L1_freeMem(workers);
+    BMP_L1_freeMem(tid);
+    BMP_L1_STATS_END(BMP_L1_API_RENDER_BATCH, count, 0);
+    return ret;
+}
+#endif
+
+#ifdef BMP_L1_ENABLE_STATS
+/**
+  * @brief  Get hot-path statistics accumulated by the calling thread.
+  * @param  pStats pointer to the destination of the statistics
+  * @retval None
+  * @detail Available only when BMP_L1_ENABLE_STATS is defined.
+  */
+void BMP_L1_getStats(BMP_L1_stats_st *pStats)
+{
+    if (pStats == NULL)
+        return;
+    *pStats = bmp_l1_stats;
+}
+
+/**
+  * @brief  Clear hot-path statistics of the calling thread.
+  * @retval None
+  * @detail Available only when BMP_L1_ENABLE_STATS is defined.
+  */
+void BMP_L1_resetStats(void)
+{
+    memset(&bmp_l1_stats, 0, sizeof(bmp_l1_stats));
+}
+#endif
+
+
+/* Private functions ---------------------------------------------------------*/
+
+// Set a pixel without statistics. Out of range coordinates are ignored.
+static void BMP_L1_putPixel(uint8_t *pbmp, uint32_t x, uint32_t y, uint8_t isWhite)
+{
+    if(pbmp == NULL)
+        return;
+
+    uint32_t width  = BMP_L1_getWidth (pbmp);
+    uint32_t height = BMP_L1_getHeight (pbmp);
+
+    if(x >= width || y >= height)
+        return;
+
+    uint8_t *pBuf = BMP_L1_getRow(pbmp, y) + (x >> 3);
+    if(isWhite & 0x01)
+        *pBuf |=  (0x80 >> (x & 0x00000007));
+    else
+        *pBuf &= ~(0x80 >> (x & 0x00000007));
+}
+
+// Get a pixel without statistics. *isWhite is left untouched for out of range coordinates.
+static void BMP_L1_peekPixel(uint8_t *pbmp, uint32_t x, uint32_t y, uint8_t *isWhite)
+{
+    if(pbmp == NULL)
+        return;
+
+    uint32_t width  = BMP_L1_getWidth(pbmp);
+    uint32_t height = BMP_L1_getHeight(pbmp);
+
+    if(x >= width || y >= height)
+        return;
+
+    uint8_t buf = *(BMP_L1_getRow(pbmp, y) + (x >> 3));
+    if(buf & (0x80 >> (x & 0x00000007)))
+        *isWhite = 1;
+    else
+        *isWhite = 0;
+}
+
+// Fill a rectangle without statistics. Returns the number of pixels written.
+static uint32_t BMP_L1_fillRect(uint8_t *pbmp,
+		uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
+        uint8_t isWhite)
+{
+    uint32_t width = BMP_L1_getWidth(pbmp);
+    uint32_t height = BMP_L1_getHeight(pbmp);
+
+    if (pbmp == NULL || x0 >= width || x1 >= width || y0 >= height || y1 >= height)
+        return 0;
+
+    uint32_t swap;
+    if(x0 > x1)
+    {
+        swap = x0;
+        x0 = x1;
+        x1 = swap;
+    }
+    if (y0 > y1)
+    {
+        swap = y0;
+        y0 = y1;
+        y1 = swap;
+    }
+
+    int32_t pitch = BMP_L1_getPitch(pbmp);
+    uint8_t *pRow = BMP_L1_getRow(pbmp, y0);
+    for(uint32_t y = y0; y <= y1; y++, pRow += pitch)
+        BMP_L1_fillSpan(pRow, x0, x1, isWhite);
+    return (x1 - x0 + 1) * (y1 - y0 + 1);
+}
+
+// Allocate through the calling thread's function if set, otherwise the global one.
+static inline void *BMP_L1_allocMem(size_t size)
+{
+    BMP_L1_Malloc_Function malloc_func = bmp_l1_global_malloc;
+#ifdef BMP_L1_USE_PTHREAD
+    if (bmp_l1_thread_malloc != NULL)
+        malloc_func = bmp_l1_thread_malloc;
+#endif
+    void *ptr = malloc_func(size);
+    if (ptr != NULL)
+        BMP_L1_STATS_ALLOC(size);
+    return ptr;
+}
+
+// Release memory of BMP_L1_allocMem() through the calling thread's function if set, otherwise the global one.
+static inline void BMP_L1_freeMem(void *ptr)
+{
+    BMP_L1_free_Function free_func = bmp_l1_global_free;
+
+    if (ptr == NULL)
+        return;
+#ifdef BMP_L1_USE_PTHREAD
+    if (bmp_l1_thread_free != NULL)
+        free_func = bmp_l1_thread_free;
+#endif
+    free_func(ptr);
+    BMP_L1_STATS_FREE();
+}
+
+// BMP_L1_createEx() without recording an API call, for use inside the library.
+static uint8_t *BMP_L1_createImage(uint32_t width, uint32_t height, uint8_t layout)
+{
+    uint8_t *pbmp;
+    uint32_t bytes_per_row = BMP_L1_getBytesPerRow(width);
+    uint32_t image_size = bytes_per_row * height;
+    uint32_t data_size = AllHeaderOffset + image_size;
+
+    /* Allocate the bitmap data */
+    pbmp = (uint8_t *)BMP_L1_allocMem(sizeof(uint8_t) * data_size);
+    if (pbmp == NULL)
+        return NULL;
+    for(uint32_t i = AllHeaderOffset; i < data_size; i++)
+        *(pbmp + i) = 0;
+
+    BMP_L1_writeHeader(pbmp, width, height, layout);
+    return pbmp;
+}
+
+// BMP_L1_free() without recording an API call, for use inside the library.
+static void BMP_L1_freeImage(uint8_t *pbmp)
+{
+    BMP_L1_freeMem(pbmp);
+}
+
+// Signed distance in bytes from row y to row y + 1.
+static int32_t BMP_L1_getPitch(uint8_t *pbmp)
+{
+    int32_t bytes_per_row = (int32_t)BMP_L1_getBytesPerRow(BMP_L1_getWidth(pbmp));
+    return BMP_L1_isTopDown(pbmp) ? bytes_per_row : -bytes_per_row;
+}
+
+// Change the height of an image in place, keeping its layout. The buffer must be large enough.
+static void BMP_L1_setHeight(uint8_t *pbmp, uint32_t height)
+{
+    uint32_t image_size = BMP_L1_getBytesPerRow(BMP_L1_getWidth(pbmp)) * height;
+    BMP_L1_write_uint32_t(AllHeaderOffset + image_size, pbmp + 0x02);
+    BMP_L1_write_uint32_t(BMP_L1_isTopDown(pbmp) ? (uint32_t)-(int32_t)height : height,
+                          pbmp + BMP_L1_FILE_HEADER_SIZE + 0x08);
+    BMP_L1_write_uint32_t(image_size, pbmp + BMP_L1_FILE_HEADER_SIZE + 0x14);
+}
+
+// Write the header and palette of a width x height image with the given layout.
+static void BMP_L1_writeHeader(uint8_t *pbmp, uint32_t width, uint32_t height, uint8_t layout)
+{
+    uint32_t image_size = BMP_L1_getBytesPerRow(width) * height;
+    uint32_t data_size = AllHeaderOffset + image_size;
+
+    // Set header's default values
+    uint8_t *tmp = pbmp;
+    *(tmp  +  0) = 'B';                                    // 'B' : Magic number
+    *(tmp  +  1) = 'M';                                    // 'M' : Magic number
+    BMP_L1_write_uint32_t(data_size        , tmp + 0x02);  // File Size
+    BMP_L1_write_uint16_t(0                , tmp + 0x06);  // Reserved1
+    BMP_L1_write_uint16_t(0                , tmp + 0x08);  // Reserved2
+    BMP_L1_write_uint32_t(AllHeaderOffset  , tmp + 0x0A);  // Offset
+    tmp += BMP_L1_FILE_HEADER_SIZE;    // Next
+
+    // Info header
+    BMP_L1_write_uint32_t( BMP_L1_INFO_HEADER_SIZE  , tmp + 0x00);   // HeaderSize
+    BMP_L1_write_uint32_t( width           , tmp + 0x04);  // width  (*** Signed value ***)
+    BMP_L1_write_uint32_t( layout == BMP_L1_TOP_DOWN ? (uint32_t)-(int32_t)height : height,
+                                             tmp + 0x08);  // height (*** Signed value ***, negative: top-down)
+    BMP_L1_write_uint16_t( 1               , tmp + 0x0C);  // planes
+    BMP_L1_write_uint16_t( 1               , tmp + 0x0E);  // Bit count
+    BMP_L1_write_uint32_t( 0               , tmp + 0x10);  // Bit compression
+    BMP_L1_write_uint32_t( image_size      , tmp + 0x14);  // Image size
+    BMP_L1_write_uint32_t( 0               , tmp + 0x18);  // X pixels per meter
+    BMP_L1_write_uint32_t( 0               , tmp + 0x1C);  // Y pixels per meter
+    BMP_L1_write_uint32_t( 2               , tmp + 0x20);  // Color index
+    BMP_L1_write_uint32_t( 0               , tmp + 0x24);  // Important index
+    tmp += BMP_L1_INFO_HEADER_SIZE;    // Next
+
+    // Palette data
+    // Black
+    *tmp++ = 0;   // Blue
+    *tmp++ = 0;   // Greem
+    *tmp++ = 0;   // Red
+    *tmp++ = 0;   // Reserved
+
+    // White
+    *tmp++ = 0xFF;   // Blue
+    *tmp++ = 0xFF;   // Greem
+    *tmp++ = 0xFF;   // Red
+    *tmp++ = 0;      // Reserved
+}
+
+// Copy n bits (MSB first) from src starting at bit srcBit to dst starting at bit dstBit.
+static void BMP_L1_copyBits(uint8_t *dst, uint32_t dstBit, const uint8_t *src, uint32_t srcBit, uint32_t n)
+{
+    while (n > 0)
+    {
+        uint32_t dOff  = dstBit & 0x07;
+        uint32_t sOff  = srcBit & 0x07;
+        uint32_t chunk = 8 - dOff;
+        if (chunk > n)
+            chunk = n;
+
+        const uint8_t *pSrc = src + (srcBit >> 3);
+        uint16_t window = (uint16_t)pSrc[0] << 8;
+        if (sOff + chunk > 8)
+            window |= pSrc[1];
+        uint8_t bits = (uint8_t)((window << sOff) >> 8);
+        uint8_t mask = (uint8_t)((uint8_t)(0xFF << (8 - chunk)) >> dOff);
+
+        uint8_t *pDst = dst + (dstBit >> 3);
+        *pDst = (uint8_t)((*pDst & ~mask) | ((bits >> dOff) & mask));
+
+        n      -= chunk;
+        dstBit += chunk;
+        srcBit += chunk;
+    }
+}
+
+// Fill bits [x0, x1] of a row.
+static void BMP_L1_fillSpan(uint8_t *pRow, uint32_t x0, uint32_t x1, uint8_t isWhite)
+{
+    uint32_t b0 = x0 >> 3, b1 = x1 >> 3;
+    uint8_t m0 = (uint8_t)(0xFF >> (x0 & 0x07));
+    uint8_t m1 = (uint8_t)(0xFF << (7 - (x1 & 0x07)));
+    uint8_t fill = (isWhite & 0x01) ? 0xFF : 0x00;
+
+    if (b0 == b1)
+    {
+        m0 &= m1;
+        pRow[b0] = (uint8_t)((pRow[b0] & ~m0) | (fill & m0));
+        return;
+    }
+    pRow[b0] = (uint8_t)((pRow[b0] & ~m0) | (fill & m0));
+    memset(pRow + b0 + 1, fill, b1 - b0 - 1);
+    pRow[b1] = (uint8_t)((pRow[b1] & ~m1) | (fill & m1));
+}
+
+// Blit without statistics. Returns the number of pixels copied.
+static uint32_t BMP_L1_blitImage(uint8_t *pbmpDst, uint8_t *pbmpSrc, int32_t x, int32_t y)
+{
+    if (pbmpDst == NULL || pbmpSrc == NULL)
+        return 0;
+
+    int32_t dw = BMP_L1_getWidth(pbmpDst),  dh = BMP_L1_getHeight(pbmpDst);
+    int32_t sw = BMP_L1_getWidth(pbmpSrc),  sh = BMP_L1_getHeight(pbmpSrc);
+    int32_t sx = x < 0 ? -x : 0, sy = y < 0 ? -y : 0;
+    int32_t dx = x < 0 ?  0 : x, dy = y < 0 ?  0 : y;
+    int32_t cols = sw - sx < dw - dx ? sw - sx : dw - dx;
+    int32_t rows = sh - sy < dh - dy ? sh - sy : dh - dy;
+    if (cols <= 0 || rows <= 0)
+        return 0;
+
+    for (int32_t r = 0; r < rows; r++)
+        BMP_L1_copyBits(BMP_L1_getRow(pbmpDst, dy + r), dx, BMP_L1_getRow(pbmpSrc, sy + r), sx, cols);
+    return (uint32_t)cols * rows;
+}
+
+// Floor of a / b for b > 0.
+static int64_t BMP_L1_floorDiv(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    return (a % b < 0) ? q - 1 : q;
+}
+
+// Narrow [*x0, *x1] to the x for which lo <= p0 + dp * x < hi.
+static void BMP_L1_warpClip(int64_t p0, int64_t dp, int64_t lo, int64_t hi, int32_t *x0, int32_t *x1)
+{
+    int64_t first, last;
+    if (dp == 0)
+    {
+        if (p0 < lo || p0 >= hi)
+            *x1 = *x0 - 1;
+        return;
+    }
+    if (dp > 0)
+    {
+        first = -BMP_L1_floorDiv(p0 - lo, dp);
+        last  =  BMP_L1_floorDiv(hi - 1 - p0, dp);
+    }
+    else
+    {
+        first = BMP_L1_floorDiv(p0 - hi, -dp) + 1;
+        last  = BMP_L1_floorDiv(p0 - lo, -dp);
+    }
+    if (first > *x0)
+        *x0 = first > *x1 ? *x1 + 1 : (int32_t)first;
+    if (last < *x1)
+        *x1 = last < *x0 ? *x0 - 1 : (int32_t)last;
+}
+
+// Source pixel at 16.16 fixed point (u, v), which must be inside of the image.
+static uint32_t BMP_L1_warpSample(const uint8_t *pRow0, int32_t pitch, int32_t u, int32_t v)
+{
+    const uint8_t *pRow = pRow0 + pitch * (v >> 16);
+    uint32_t x = (uint32_t)u >> 16;
+    return (pRow[x >> 3] >> (7 - (x & 0x07))) & 0x01;
+}
+
+// Table of 256 entries of factor bytes: each bit of the index repeated factor (1 to 8) times.
+static void BMP_L1_spreadTable(uint8_t *table, uint32_t factor)
+{
+    for (uint32_t b = 0; b < 256; b++)
+    {
+        uint64_t bits = 0;
+        for (uint32_t i = 0; i < 8; i++)
+            bits = (bits << factor) | (((b >> (7 - i)) & 0x01) ? (((uint64_t)1 << factor) - 1) : 0);
+        for (uint32_t i = 0; i < factor; i++)
+            table[b * factor + i] = (uint8_t)(bits >> (8 * (factor - 1 - i)));
+    }
+}
+
+// Write a row of width pixels (= factor x source width) by expanding each source byte with the table.
+static void BMP_L1_spreadRow(uint8_t *pDst, const uint8_t *pSrc, const uint8_t *table, uint32_t factor, uint32_t width)
+{
+    uint32_t bytes = (width + 7) >> 3;
+    uint32_t i;
+
+    switch (factor)
+    {
+    case 2:
+        for (i = 0; i + 2 <= bytes; i += 2)
+            memcpy(pDst + i, table + 2 * *pSrc++, 2);
+        break;
+    case 4:
+        for (i = 0; i + 4 <= bytes; i += 4)
+            memcpy(pDst + i, table + 4 * *pSrc++, 4);
+        break;
+    case 8:
+        for (i = 0; i + 8 <= bytes; i += 8)
+            memcpy(pDst + i, table + 8 * *pSrc++, 8);
+        break;
+    default:
+        for (i = 0; i + factor <= bytes; i += factor)
+            memcpy(pDst + i, table + factor * *pSrc++, factor);
+        break;
+    }
+    if (i < bytes)
+        memcpy(pDst + i, table + factor * *pSrc, bytes - i);
+
+    // Clear the bits of the row padding
+    if (width & 0x07)
+        pDst[bytes - 1] &= (uint8_t)(0xFF << (8 - (width & 0x07)));
+}
+
+// Draw a line with signed coordinates, clipping every pixel to the image.
+static void BMP_L1_renderLine(uint8_t *pbmp, int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint8_t isWhite)
+{
+    int32_t width  = BMP_L1_getWidth (pbmp);
+    int32_t height = BMP_L1_getHeight(pbmp);
+    uint8_t *pbmp_data = BMP_L1_getRow(pbmp, 0);
+    int32_t pitch = BMP_L1_getPitch(pbmp);
+
+    int32_t dx = x1 - x0 > 0 ? x1 - x0 : x0 - x1;
+    int32_t sx = x0 < x1 ? 1 : -1;
+    int32_t dy = y1 - y0 > 0 ? y1 - y0 : y0 - y1;
+    int32_t sy = y0 < y1 ? 1 : -1;
+    int32_t err = dx - dy;
+    int32_t e2;
+
+    for (;;)
+    {
+        if (x0 >= 0 && x0 < width && y0 >= 0 && y0 < height)
+        {
+            uint8_t *pBuf = pbmp_data + pitch * y0 + (x0 >> 3);
+            if(isWhite & 0x01)
+                *pBuf |=  (0x80 >> (x0 & 0x00000007));
+            else
+                *pBuf &= ~(0x80 >> (x0 & 0x00000007));
+        }
+
+        if (x0 == x1 && y0 == y1)
+            break;
+
+        e2 = 2*err;
+        if (e2 > -dy) {err -= dy;   x0 += sx;}
+        if (e2 <  dx) {err += dx;   y0 += sy;}
+    }
+}
+
+// Draw text with signed coordinates, clipping every pixel to the image.
+static void BMP_L1_renderText(uint8_t *pbmp, const char *text, BMP_L1_font_st font,
+        int32_t x_start, int32_t y_start, uint8_t isWhite)
+{
+    int32_t imgWidth  = BMP_L1_getWidth(pbmp);
+    int32_t imgHeight = BMP_L1_getHeight(pbmp);
+    int bytesPerChar = font.char_width / 8;
+    if(font.char_width % 8 > 0)
+        bytesPerChar++;
+
+    int32_t yTxtStart = y_start < 0 ? -y_start : 0;
+    int32_t yTxtEnd   = imgHeight - y_start < font.char_height ? imgHeight - y_start : font.char_height;
+
+    for (int32_t i = 0; text[i] != '\0'; i++)
+    {
+        int32_t x_char = x_start + i * font.char_width;
+        if (x_char >= imgWidth)
+            break;
+        const uint8_t *pGlyph = font.p + (uint8_t)text[i] * bytesPerChar * font.char_height;
+
+        for (int32_t yTxt = yTxtStart; yTxt < yTxtEnd; yTxt++)
+        {
+            uint8_t *pRow = BMP_L1_getRow(pbmp, y_start + yTxt);
+            for (int32_t xTxt = 0; xTxt < font.char_width; xTxt++)
+            {
+                int32_t x = x_char + xTxt;
+                if (x < 0)
+                    continue;
+                if (x >= imgWidth)
+                    break;
+                if (pGlyph[yTxt * bytesPerChar + (bytesPerChar - 1) - (xTxt >> 3)] & (0x80 >> (xTxt & 0x07)))
+                {
+                    if (isWhite & 0x01)
+                        pRow[x >> 3] |=  (0x80 >> (x & 0x07));
+                    else
+                        pRow[x >> 3] &= ~(0x80 >> (x & 0x07));
+                }
+            }
+        }
+    }
+}
+
+// Compare the first width pixels of two rows a word at a time.
+static uint8_t BMP_L1_rowsEqual(const uint8_t *a, const uint8_t *b, uint32_t width)
+{
+    uint32_t bytes = width >> 3;
+    uint32_t i = 0;
+
+    for (; i + 8 <= bytes; i += 8)
+    {
+        uint64_t wa, wb;
+        memcpy(&wa, a + i, 8);
+        memcpy(&wb, b + i, 8);
+        if (wa != wb)
+            return 0;
+    }
+    for (; i < bytes; i++)
+    {
+        if (a[i] != b[i])
+            return 0;
+    }
+    if (width & 0x07)
+    {
+        uint8_t mask = (uint8_t)(0xFF << (8 - (width & 0x07)));
+        if ((a[bytes] ^ b[bytes]) & mask)
+            return 0;
+    }
+    return 1;
+}
+
+// Encode the patch from pbmpA to pbmpB into out (NULL: only measure). Returns the patch size.
+static uint32_t BMP_L1_diff_encode(uint8_t *pbmpA, uint8_t *pbmpB, uint8_t *out)
+{
+    uint32_t width  = BMP_L1_getWidth(pbmpA);
+    uint32_t height = BMP_L1_getHeight(pbmpA);
+    uint32_t bytes  = (width + 7) >> 3;
+    uint8_t  tail   = (width & 0x07) ? (uint8_t)(0xFF << (8 - (width & 0x07))) : 0xFF;
+    uint32_t ranges = 0;
+    BMP_L1_rle_st rle;
+
+    rle.out     = out;
+    rle.size    = BMP_L1_PATCH_HEADER_SIZE;
+    rle.nlit    = 0;
+    rle.run_len = 0;
+
+    for (uint32_t y = 0; y < height; )
+    {
+        if (BMP_L1_rowsEqual(BMP_L1_getRow(pbmpA, y), BMP_L1_getRow(pbmpB, y), width))
+        {
+            y++;
+            continue;
+        }
+
+        // Extend the range over changed rows and short gaps of unchanged ones
+        uint32_t first = y, last = y;
+        for (y++; y < height && y <= last + 1 + BMP_L1_PATCH_MERGE_ROWS; y++)
+        {
+            if (!BMP_L1_rowsEqual(BMP_L1_getRow(pbmpA, y), BMP_L1_getRow(pbmpB, y), width))
+                last = y;
+        }
+        y = last + 1;
+
+        if (out != NULL)
+        {
+            BMP_L1_write_uint32_t(first,            out + rle.size);
+            BMP_L1_write_uint32_t(last - first + 1, out + rle.size + 4);
+        }
+        rle.size += BMP_L1_PATCH_RANGE_SIZE;
+        for (uint32_t yy = first; yy <= last; yy++)
+        {
+            const uint8_t *pa = BMP_L1_getRow(pbmpA, yy);
+            const uint8_t *pb = BMP_L1_getRow(pbmpB, yy);
+            for (uint32_t i = 0; i + 1 < bytes; i++)
+                BMP_L1_rle_byte(&rle, pa[i] ^ pb[i]);
+            BMP_L1_rle_byte(&rle, (pa[bytes - 1] ^ pb[bytes - 1]) & tail);
+        }
+        BMP_L1_rle_flush(&rle, 1);
+        ranges++;
+    }
+
+    if (out != NULL)
+    {
+        out[0] = 'L';
+        out[1] = '1';
+        out[2] = 'D';
+        out[3] = 'P';
+        BMP_L1_write_uint32_t(rle.size, out + 0x04);
+        BMP_L1_write_uint32_t(width,    out + 0x08);
+        BMP_L1_write_uint32_t(height,   out + 0x0C);
+        BMP_L1_write_uint32_t(ranges,   out + 0x10);
+    }
+    return rle.size;
+}
+
+// Apply the ranges of a patch between p and end to pbmp. Every read is bounded by end.
+static int BMP_L1_diff_decode(uint8_t *pbmp, uint8_t *p, uint8_t *end, uint32_t ranges, uint64_t *rows_touched)
+{
+    uint32_t height = BMP_L1_getHeight(pbmp);
+    uint32_t bytes  = (BMP_L1_getWidth(pbmp) + 7) >> 3;
+
+    for (uint32_t r = 0; r < ranges; r++)
+    {
+        if (end - p < BMP_L1_PATCH_RANGE_SIZE)
+            return -1;
+        uint32_t y    = BMP_L1_read_uint32_t(p);
+        uint32_t rows = BMP_L1_read_uint32_t(p + 4);
+        p += BMP_L1_PATCH_RANGE_SIZE;
+        if (y >= height || rows > height - y)
+            return -1;
+        *rows_touched += rows;
+
+        // Decode runs straight into the rows
+        uint32_t remain = rows * bytes;
+        uint32_t col = 0;
+        uint8_t *pRow = rows > 0 ? BMP_L1_getRow(pbmp, y) : NULL;
+        while (remain > 0)
+        {
+            if (p >= end)
+                return -1;
+            uint8_t c = *p++;
+            uint32_t n = c < 0x80 ? (uint32_t)c + 1 : (uint32_t)(c - 0x80) + 3;
+            uint8_t literal = c < 0x80;
+            if (n > remain || (literal ? (uint32_t)(end - p) < n : p >= end))
+                return -1;
+            uint8_t value = literal ? 0 : *p++;
+            remain -= n;
+
+            while (n > 0)
+            {
+                uint32_t chunk = bytes - col < n ? bytes - col : n;
+                if (literal)
+                {
+                    for (uint32_t i = 0; i < chunk; i++)
+                        pRow[col + i] ^= p[i];
+                    p += chunk;
+                }
+                else if (value != 0)
+                {
+                    for (uint32_t i = 0; i < chunk; i++)
+                        pRow[col + i] ^= value;
+                }
+                col += chunk;
+                n   -= chunk;
+                if (col == bytes && remain + n > 0)
+                {
+                    col = 0;
+                    pRow = BMP_L1_getRow(pbmp, ++y);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// Emit one byte of encoded output.
+static void BMP_L1_rle_put(BMP_L1_rle_st *rle, uint8_t byte)
+{
+    if (rle->out != NULL)
+        rle->out[rle->size] = byte;
+    rle->size++;
+}
+
+// Emit the pending literal bytes.
+static void BMP_L1_rle_literals(BMP_L1_rle_st *rle)
+{
+    if (rle->nlit == 0)
+        return;
+    BMP_L1_rle_put(rle, (uint8_t)(rle->nlit - 1));
+    for (uint32_t i = 0; i < rle->nlit; i++)
+        BMP_L1_rle_put(rle, rle->lit[i]);
+    rle->nlit = 0;
+}
+
+// Close the pending run. Runs shorter than 3 bytes join the literals, which are
+// emitted before a longer run or, when final is set, at the end of the data.
+static void BMP_L1_rle_flush(BMP_L1_rle_st *rle, uint8_t final)
+{
+    if (rle->run_len < 3)
+    {
+        for (uint32_t i = 0; i < rle->run_len; i++)
+        {
+            if (rle->nlit == sizeof(rle->lit))
+                BMP_L1_rle_literals(rle);
+            rle->lit[rle->nlit++] = rle->run_byte;
+        }
+        if (final)
+            BMP_L1_rle_literals(rle);
+    }
+    else
+    {
+        BMP_L1_rle_literals(rle);
+        BMP_L1_rle_put(rle, (uint8_t)(0x80 + rle->run_len - 3));
+        BMP_L1_rle_put(rle, rle->run_byte);
+    }
+    rle->run_len = 0;
+}
+
+// Feed one byte to the encoder.
+static void BMP_L1_rle_byte(BMP_L1_rle_st *rle, uint8_t byte)
+{
+    if (rle->run_len > 0 && byte == rle->run_byte && rle->run_len < 0x7F + 3)
+    {
+        rle->run_len++;
+        return;
+    }
+    BMP_L1_rle_flush(rle, 0);
+    rle->run_byte = byte;
+    rle->run_len  = 1;
+}
+
+// Write a big-endian uint32_t.
+static void BMP_L1_write_uint32_t_be(uint32_t Src, uint8_t *pDst)
+{
+    *(pDst    ) = (uint8_t)(Src >> 24);
+    *(pDst + 1) = (uint8_t)(Src >> 16);
+    *(pDst + 2) = (uint8_t)(Src >>  8);
+    *(pDst + 3) = (uint8_t)(Src      );
+}
+
+// Update a CRC-32 (PNG/zlib polynomial) with a nibble-wide table.
+static uint32_t BMP_L1_crc32(uint32_t crc, const uint8_t *data, uint32_t size)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return crc;
+}
+
+// Write one PNG chunk.
+static void BMP_L1_png_chunk(BMP_L1_png_st *st, const char *type, const uint8_t *data, uint32_t size)
+{
+    uint8_t buf[8];
+    uint32_t crc;
+
+    if (st->status != 0)
+        return;
+    BMP_L1_write_uint32_t_be(size, buf);
+    memcpy(buf + 4, type, 4);
+    crc = BMP_L1_crc32(0xFFFFFFFF, buf + 4, 4);
+    crc = BMP_L1_crc32(crc, data, size) ^ 0xFFFFFFFF;
+
+    if (st->write(st->ctx, buf, 8) != 0 || (size > 0 && st->write(st->ctx, data, size) != 0))
+    {
+        st->status = -1;
+        return;
+    }
+    BMP_L1_write_uint32_t_be(crc, buf);
+    if (st->write(st->ctx, buf, 4) != 0)
+        st->status = -1;
+}
+
+// Append one byte of zlib data, emitting an IDAT chunk whenever the buffer is full.
+static void BMP_L1_png_byte(BMP_L1_png_st *st, uint8_t byte)
+{
+    st->out[st->nout++] = byte;
+    if (st->nout == sizeof(st->out))
+    {
+        BMP_L1_png_chunk(st, "IDAT", st->out, st->nout);
+        st->nout = 0;
+    }
+}
+
+// Append n bits (LSB first).
+static void BMP_L1_png_bits(BMP_L1_png_st *st, uint32_t value, uint32_t n)
+{
+    st->bitbuf |= value << st->bitcount;
+    st->bitcount += n;
+    while (st->bitcount >= 8)
+    {
+        BMP_L1_png_byte(st, (uint8_t)st->bitbuf);
+        st->bitbuf >>= 8;
+        st->bitcount -= 8;
+    }
+}
+
+// Append a Huffman code (MSB first).
+static void BMP_L1_png_code(BMP_L1_png_st *st, uint32_t code, uint32_t n)
+{
+    uint32_t reversed = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        reversed = (reversed << 1) | (code & 0x01);
+        code >>= 1;
+    }
+    BMP_L1_png_bits(st, reversed, n);
+}
+
+// Append a literal/length symbol with the fixed Huffman code.
+static void BMP_L1_png_symbol(BMP_L1_png_st *st, uint32_t symbol)
+{
+    if (symbol < 144)
+        BMP_L1_png_code(st, 0x30 + symbol, 8);
+    else if (symbol < 256)
+        BMP_L1_png_code(st, 0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        BMP_L1_png_code(st, symbol - 256, 7);
+    else
+        BMP_L1_png_code(st, 0xC0 + symbol - 280, 8);
+}
+
+// Size in bits of a match of length [3, 258] at distance [1, 32768], appended when emit is set.
+static uint32_t BMP_L1_png_match(BMP_L1_png_st *st, uint32_t length, uint32_t distance, uint8_t emit)
+{
+    static const uint16_t lbase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                       35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t  lext[29]  = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                       3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t dbase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                       257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const uint8_t  dext[30]  = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                       7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    uint32_t l = 28, d = 29;
+
+    while (lbase[l] > length)
+        l--;
+    while (dbase[d] > distance)
+        d--;
+    if (emit)
+    {
+        BMP_L1_png_symbol(st, 257 + l);
+        if (lext[l] > 0)
+            BMP_L1_png_bits(st, length - lbase[l], lext[l]);
+        BMP_L1_png_code(st, d, 5);
+        if (dext[d] > 0)
+            BMP_L1_png_bits(st, distance - dbase[d], dext[d]);
+    }
+    return (257 + l < 280 ? 7 : 8) + lext[l] + 5 + dext[d];
+}
+
+// Write the current block with fixed Huffman codes, or as stored data when that is smaller.
+static void BMP_L1_png_block(BMP_L1_png_st *st, uint8_t final)
+{
+    uint32_t len = st->pos_cur - st->pos_block;
+    uint32_t stored_bits = (8 - ((st->bitcount + 3) & 0x07)) % 8 + 32 + 8 * len;
+
+    BMP_L1_png_bits(st, final, 1);
+    if (st->block_bits + 7 <= stored_bits)
+    {
+        BMP_L1_png_bits(st, 1, 2);
+        for (uint32_t i = 0; i < st->nsym; i++)
+        {
+            if (st->sym[i] < 256)
+                BMP_L1_png_symbol(st, st->sym[i]);
+            else
+            {
+                BMP_L1_png_match(st, st->sym[i] - 256u, st->sym[i + 1], 1);
+                i++;
+            }
+        }
+        BMP_L1_png_symbol(st, 256);
+    }
+    else
+    {
+        // The block is still in the window: pos_in - pos_block <= LOOKAHEAD + MAX_DIST
+        BMP_L1_png_bits(st, 0, 2);
+        if (st->bitcount > 0)
+            BMP_L1_png_bits(st, 0, 8 - st->bitcount);
+        BMP_L1_png_byte(st, (uint8_t)len);
+        BMP_L1_png_byte(st, (uint8_t)(len >> 8));
+        BMP_L1_png_byte(st, (uint8_t)~len);
+        BMP_L1_png_byte(st, (uint8_t)(~len >> 8));
+        for (uint32_t pos = st->pos_block; pos < st->pos_cur; pos++)
+            BMP_L1_png_byte(st, st->window[pos & BMP_L1_PNG_WINDOW_MASK]);
+    }
+
+    st->pos_block  = st->pos_cur;
+    st->nsym       = 0;
+    st->block_bits = 0;
+}
+
+// Hash of the 3 bytes at pos.
+static uint32_t BMP_L1_png_hash(BMP_L1_png_st *st, uint32_t pos)
+{
+    uint32_t v = ((uint32_t)st->window[pos & BMP_L1_PNG_WINDOW_MASK] << 16)
+               | ((uint32_t)st->window[(pos + 1) & BMP_L1_PNG_WINDOW_MASK] << 8)
+               |  (uint32_t)st->window[(pos + 2) & BMP_L1_PNG_WINDOW_MASK];
+    return (v * 2654435761u) >> (32 - BMP_L1_PNG_HASH_BITS);
+}
+
+// Encode the symbol at pos_cur: the most recent match with the same hash, or a literal.
+// A block ends when its symbols are full or it spans MAX_DIST bytes, so a stored block can be taken from the window.
+static void BMP_L1_png_step(BMP_L1_png_st *st)
+{
+    uint32_t pos = st->pos_cur;
+    uint32_t avail = st->pos_in - pos;
+    uint32_t length = 0, distance = 0;
+
+    if (st->nsym + 2 > BMP_L1_PNG_BLOCK_SYMBOLS || pos - st->pos_block >= BMP_L1_PNG_MAX_DIST)
+        BMP_L1_png_block(st, 0);
+    if (avail > BMP_L1_PNG_MAX_DIST - (pos - st->pos_block))
+        avail = BMP_L1_PNG_MAX_DIST - (pos - st->pos_block);
+
+    if (avail >= 3)
+    {
+        uint32_t h = BMP_L1_png_hash(st, pos);
+        uint32_t cand = st->head[h];
+        st->head[h] = pos + 1;
+        if (cand != 0 && pos - (cand - 1) <= BMP_L1_PNG_MAX_DIST)
+        {
+            uint32_t src = cand - 1;
+            uint32_t limit = avail < 258 ? avail : 258;
+            while (length < limit
+                && st->window[(src + length) & BMP_L1_PNG_WINDOW_MASK] == st->window[(pos + length) & BMP_L1_PNG_WINDOW_MASK])
+                length++;
+            distance = pos - src;
+        }
+    }
+
+    if (length < 3)
+    {
+        uint8_t literal = st->window[pos & BMP_L1_PNG_WINDOW_MASK];
+        st->sym[st->nsym++] = literal;
+        st->block_bits += literal < 144 ? 8 : 9;
+        st->pos_cur++;
+        return;
+    }
+
+    st->sym[st->nsym++] = (uint16_t)(256 + length);
+    st->sym[st->nsym++] = (uint16_t)distance;
+    st->block_bits += BMP_L1_png_match(st, length, distance, 0);
+    for (uint32_t p = pos + 1; p < pos + length && p + 3 <= st->pos_in; p++)
+        st->head[BMP_L1_png_hash(st, p)] = p + 1;
+    st->pos_cur += length;
+}
+
+// Feed one byte of filtered scanline data.
+static void BMP_L1_png_feed(BMP_L1_png_st *st, uint8_t byte)
+{
+    st->adler_a = (st->adler_a + byte) % 65521;
+    st->adler_b = (st->adler_b + st->adler_a) % 65521;
+
+    st->window[st->pos_in & BMP_L1_PNG_WINDOW_MASK] = byte;
+    st->pos_in++;
+    if (st->pos_in - st->pos_cur >= BMP_L1_PNG_LOOKAHEAD)
+        BMP_L1_png_step(st);
+}
+
+// Reserve a command record and return a pointer to its payload. Returns NULL when out of memory.
+static void *BMP_L1_dlist_append(BMP_L1_dlist_st *dl, BMP_L1_dl_type_e type, uint8_t isWhite, uint32_t payload_size,
+        int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    uint32_t size = BMP_L1_DL_ALIGN(sizeof(BMP_L1_dl_cmd_st) + payload_size);
+
+    if (dl->size + size > dl->capacity)
+    {
+        uint32_t capacity = dl->capacity ? dl->capacity : 256;
+        while (capacity < dl->size + size)
+            capacity *= 2;
+
+        uint8_t *buf = (uint8_t *)BMP_L1_allocMem(capacity);
+        if (buf == NULL)
+            return NULL;
+        if (dl->buf != NULL)
+        {
+            memcpy(buf, dl->buf, dl->size);
+            BMP_L1_freeMem(dl->buf);
+        }
+        dl->buf = buf;
+        dl->capacity = capacity;
+    }
+
+    BMP_L1_dl_cmd_st *cmd = (BMP_L1_dl_cmd_st *)(dl->buf + dl->size);
+    cmd->type     = (uint8_t)type;
+    cmd->isWhite  = isWhite;
+    cmd->reserved = 0;
+    cmd->size     = size;
+    cmd->x0       = x0;
+    cmd->y0       = y0;
+    cmd->x1       = x1;
+    cmd->y1       = y1;
+    dl->size += size;
+    return cmd + 1;
+}
+
+// Replay every command intersecting canvas rows [y, y + height of pband) into pband.
+static void BMP_L1_dlist_renderBand(BMP_L1_dlist_st *dl, uint8_t *pband, uint32_t y)
+{
+    int32_t band_top    = (int32_t)y;
+    int32_t band_bottom = (int32_t)(y + BMP_L1_getHeight(pband)) - 1;
+
+    memset(pband + AllHeaderOffset, 0, BMP_L1_getImageSize(pband));
+
+    for (uint32_t offset = 0; offset < dl->size; )
+    {
+        BMP_L1_dl_cmd_st *cmd = (BMP_L1_dl_cmd_st *)(dl->buf + offset);
+        void *payload = cmd + 1;
+        offset += cmd->size;
+
+        if (cmd->y1 < band_top || cmd->y0 > band_bottom)
+            continue;
+
+        switch (cmd->type)
+        {
+        case BMP_L1_DL_LINE:
+        {
+            int32_t *p = (int32_t *)payload;
+            BMP_L1_renderLine(pband, p[0], p[1] - band_top, p[2], p[3] - band_top, cmd->isWhite);
+            break;
+        }
+        case BMP_L1_DL_RECT:
+        {
+            int32_t top    = cmd->y0 > band_top    ? cmd->y0 : band_top;
+            int32_t bottom = cmd->y1 < band_bottom ? cmd->y1 : band_bottom;
+            for (int32_t yy = top; yy <= bottom; yy++)
+                BMP_L1_fillSpan(BMP_L1_getRow(pband, yy - band_top), cmd->x0, cmd->x1, cmd->isWhite);
+            break;
+        }
+        case BMP_L1_DL_TEXT:
+        {
+            BMP_L1_font_st font;
+            memcpy(&font, payload, sizeof(BMP_L1_font_st));
+            BMP_L1_renderText(pband, (const char *)payload + sizeof(BMP_L1_font_st), font,
+                    cmd->x0, cmd->y0 - band_top, cmd->isWhite);
+            break;
+        }
+        case BMP_L1_DL_BLIT:
+            BMP_L1_blitImage(pband, *(uint8_t **)payload, cmd->x0, cmd->y0 - band_top);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+#ifdef BMP_L1_USE_PTHREAD
+// Worker of BMP_L1_dlist_renderParallel. Claims bands in order and hands them to the sink in order.
+static void *BMP_L1_dlist_worker(void *arg)
+{
+    BMP_L1_bandjob_st *job = (BMP_L1_bandjob_st *)arg;
+    uint8_t *pband = BMP_L1_createImage(job->dl->width, job->band_height, BMP_L1_TOP_DOWN);
+
+    if (pband == NULL)
+    {
+        pthread_mutex_lock(&job->lock);
+        job->status = -1;
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->lock);
+        return NULL;
+    }
+
+    for (;;)
+    {
+        uint32_t band;
+        int status;
+
+        pthread_mutex_lock(&job->lock);
+        band = job->next_band;
+        if (job->status == 0 && band < job->band_num)
+            job->next_band++;
+        status = job->status;
+        pthread_mutex_unlock(&job->lock);
+        if (status != 0 || band >= job->band_num)
+            break;
+
+        uint32_t y = band * job->band_height;
+        uint32_t rows = job->dl->height - y < job->band_height ? job->dl->height - y : job->band_height;
+        if (rows != BMP_L1_getHeight(pband))
+            BMP_L1_setHeight(pband, rows);
+        BMP_L1_dlist_renderBand(job->dl, pband, y);
+
+        pthread_mutex_lock(&job->lock);
+        while (job->next_emit != band && job->status == 0)
+            pthread_cond_wait(&job->cond, &job->lock);
+        status = job->status;
+        pthread_mutex_unlock(&job->lock);
+        if (status != 0)
+            break;
+
+        // Only the owner of band next_emit gets here, so the sink is never called concurrently.
+        status = job->sink(job->ctx, pband, y) != 0 ? -1 : 0;
+
+        pthread_mutex_lock(&job->lock);
+        if (status != 0)
+            job->status = -1;
+        job->next_emit++;
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->lock);
+        if (status != 0)
+            break;
+    }
+
+    BMP_L1_freeImage(pband);
+    return NULL;
+}
+
+// Entry of a spawned worker of BMP_L1_dlist_renderParallel. Its counters go to the calling thread.
+static void *BMP_L1_dlist_thread(void *arg)
+{
+    BMP_L1_dlist_worker(arg);
+#ifdef BMP_L1_ENABLE_STATS
+    BMP_L1_bandjob_st *job = (BMP_L1_bandjob_st *)arg;
+    pthread_mutex_lock(&job->lock);
+    BMP_L1_stats_sum(&job->stats, &bmp_l1_stats);
+    pthread_mutex_unlock(&job->lock);
+#endif
+    return NULL;
+}
+
+// Take an unused image of at least size bytes from a worker's pool, allocating one if needed.
+static BMP_L1_pool_image_st *BMP_L1_pool_acquire(BMP_L1_pool_st *pool, uint32_t size)
+{
+    BMP_L1_pool_image_st *image;
+
+    for (image = pool->head; image != NULL; image = image->next)
+    {
+        if (image->capacity >= size && atomic_load_explicit(&image->in_use, memory_order_acquire) == 0)
+        {
+            atomic_store_explicit(&image->in_use, 1, memory_order_relaxed);
+            return image;
+        }
+    }
+
+    image = (BMP_L1_pool_image_st *)BMP_L1_allocMem(sizeof(BMP_L1_pool_image_st) + size);
+    if (image == NULL)
+        return NULL;
+    image->pbmp     = (uint8_t *)(image + 1);
+    image->capacity = size;
+    atomic_init(&image->in_use, 1);
+    image->next = pool->head;
+    pool->head  = image;
+    return image;
+}
+
+// Hand out every finished result in submission order. Only one thread does so at a time:
+// whoever raises emit_pending from zero drains, and drains again for every request that arrived meanwhile.
+static void BMP_L1_batch_emit(BMP_L1_batchjob_st *job)
+{
+    if (atomic_fetch_add(&job->emit_pending, 1) != 0)
+        return;
+
+    do
+    {
+        uint32_t index = atomic_load(&job->next_emit);
+        while (index < job->count && atomic_load(&job->aborted) == 0
+            && atomic_load_explicit(&job->slots[index].done, memory_order_acquire) != 0)
+        {
+            BMP_L1_pool_image_st *image = job->slots[index].image;
+            if (job->batch->result(job->batch->ctx, index, image != NULL ? image->pbmp : NULL) != 0)
+            {
+                atomic_store(&job->status, -1);
+                atomic_store(&job->aborted, 1);
+            }
+            if (image != NULL)
+                atomic_store_explicit(&image->in_use, 0, memory_order_release);
+            index++;
+            atomic_store(&job->next_emit, index);
+        }
+
+        pthread_mutex_lock(&job->lock);
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->lock);
+    } while (atomic_fetch_sub(&job->emit_pending, 1) != 1);
+}
+
+// Worker of BMP_L1_renderBatch.
+static void *BMP_L1_batch_worker(void *arg)
+{
+    BMP_L1_batchworker_st *worker = (BMP_L1_batchworker_st *)arg;
+    BMP_L1_batchjob_st *job = worker->job;
+    BMP_L1_pool_st *pool = &job->pools[worker->worker];
+    BMP_L1_Malloc_Function saved_malloc = bmp_l1_thread_malloc;
+    BMP_L1_free_Function saved_free = bmp_l1_thread_free;
+
+    if (job->batch->worker_init != NULL)
+        job->batch->worker_init(job->batch->ctx, worker->worker);
+
+    for (;;)
+    {
+        uint32_t index = atomic_fetch_add(&job->next_job, 1);
+        if (index >= job->count || atomic_load(&job->aborted) != 0)
+            break;
+
+        // Bound the number of results (and pooled images) waiting for an older job.
+        if (index >= atomic_load(&job->next_emit) + job->lookahead)
+        {
+            pthread_mutex_lock(&job->lock);
+            while (index >= atomic_load(&job->next_emit) + job->lookahead && atomic_load(&job->aborted) == 0)
+                pthread_cond_wait(&job->cond, &job->lock);
+            pthread_mutex_unlock(&job->lock);
+        }
+
+        const BMP_L1_job_st *p = &job->jobs[index];
+        uint32_t size = AllHeaderOffset + BMP_L1_getBytesPerRow(p->width) * p->height;
+        BMP_L1_pool_image_st *image = BMP_L1_pool_acquire(pool, size);
+        if (image != NULL)
+        {
+            BMP_L1_writeHeader(image->pbmp, p->width, p->height, BMP_L1_BOTTOM_UP);
+            memset(image->pbmp + AllHeaderOffset, 0, size - AllHeaderOffset);
+            if (p->render(p->ctx, image->pbmp) != 0)
+            {
+                atomic_store_explicit(&image->in_use, 0, memory_order_release);
+                image = NULL;
+            }
+        }
+        if (image == NULL)
+            atomic_store(&job->status, -1);
+
+        job->slots[index].image = image;
+        atomic_store(&job->slots[index].done, 1);
+        BMP_L1_batch_emit(job);
+    }
+
+    // Another worker may still be handing out an image of this pool, so wait until all have
+    // left the loop, then release the pool with the allocator it was taken from.
+    pthread_mutex_lock(&job->lock);
+    if (--job->active == 0)
+        pthread_cond_broadcast(&job->cond);
+    while (job->active != 0)
+        pthread_cond_wait(&job->cond, &job->lock);
+    pthread_mutex_unlock(&job->lock);
+
+    while (pool->head != NULL)
+    {
+        BMP_L1_pool_image_st *next = pool->head->next;
+        BMP_L1_freeMem(pool->head);
+        pool->head = next;
+    }
+
+    bmp_l1_thread_malloc = saved_malloc;
+    bmp_l1_thread_free = saved_free;
+    return NULL;
+}
+
+// Entry of a spawned worker of BMP_L1_renderBatch. Its counters go to the calling thread.
+static void *BMP_L1_batch_thread(void *arg)
+{
+    BMP_L1_batch_worker(arg);
+#ifdef BMP_L1_ENABLE_STATS
+    BMP_L1_batchjob_st *job = ((BMP_L1_batchworker_st *)arg)->job;
+    pthread_mutex_lock(&job->lock);
+    BMP_L1_stats_sum(&job->stats, &bmp_l1_stats);
+    pthread_mutex_unlock(&job->lock);
+#endif
+    return NULL;
+}
+#endif
+
+#ifdef BMP_L1_ENABLE_STATS
+// Accumulate one call into the thread-local statistics.
+static void BMP_L1_stats_add(BMP_L1_api_e api, uint64_t pixels, uint64_t bytes, uint64_t ticks)
+{
+    BMP_L1_api_stats_st *p = &bmp_l1_stats.api[api];
+    p->calls++;
+    p->pixels += pixels;
+    p->bytes  += bytes;
+    p->ticks  += ticks;
+}
+
+#ifdef BMP_L1_USE_PTHREAD
+// Add the counters of src to dst.
+static void BMP_L1_stats_sum(BMP_L1_stats_st *dst, const BMP_L1_stats_st *src)
+{
+    for (int i = 0; i < BMP_L1_API_NUM; i++)
+    {
+        dst->api[i].calls  += src->api[i].calls;
+        dst->api[i].pixels += src->api[i].pixels;
+        dst->api[i].bytes  += src->api[i].bytes;
+        dst->api[i].ticks  += src->api[i].ticks;
+    }
+    dst->alloc_count += src->alloc_count;
+    dst->alloc_bytes += src->alloc_bytes;
+    dst->free_count  += src->free_count;
+}
+#endif
+#endif
 
 // Calculate the number of bytes used to store a single image row.
 // This is always rounded up to the next multiple of 4.
 static uint32_t BMP_L1_getBytesPerRow(uint32_t width)
 {
-    if(width & 0x0000001FF)
+    if(width & 0x0000001F)
         return ((width >> 5) << 2) + 4;
     else
         return ((width >> 5) << 2);
@@ -31,17 +31,151 @@ extern "C" {
 // #define USE_FONT_24X40
 // #define USE_FONT_32X53
 
+/** @def
+ * Enable hot-path statistics (call counts, pixels/bytes touched, allocations).
+ * Counters are accumulated per thread and read with BMP_L1_getStats().
+ * When not defined, all instrumentation compiles to nothing.
+ *
+ * To also accumulate timings, define BMP_L1_STATS_CLOCK() as an expression
+ * returning a monotonic tick count (e.g. DWT->CYCCNT or a nanosecond timer),
+ * and BMP_L1_STATS_CLOCK_TYPE as its type when it is narrower than uint64_t.
+ */
+// #define BMP_L1_ENABLE_STATS
+// #define BMP_L1_STATS_CLOCK()     (DWT->CYCCNT)
+// #define BMP_L1_STATS_CLOCK_TYPE  uint32_t
+
+/** @def
+ * Memory used by BMP_L1_writePNG(): LZ77 window of 2^BMP_L1_PNG_WINDOW_BITS bytes (9..15),
+ * hash table of 2^BMP_L1_PNG_HASH_BITS entries, deflate blocks of up to BMP_L1_PNG_BLOCK_SYMBOLS
+ * 16-bit symbols, and IDAT chunks of BMP_L1_PNG_IDAT_SIZE bytes.
+ */
+#ifndef BMP_L1_PNG_WINDOW_BITS
+#define BMP_L1_PNG_WINDOW_BITS  12
+#endif
+#ifndef BMP_L1_PNG_HASH_BITS
+#define BMP_L1_PNG_HASH_BITS    10
+#endif
+#ifndef BMP_L1_PNG_BLOCK_SYMBOLS
+#define BMP_L1_PNG_BLOCK_SYMBOLS    1024
+#endif
+#ifndef BMP_L1_PNG_IDAT_SIZE
+#define BMP_L1_PNG_IDAT_SIZE    1024
+#endif
+
+/** @def
+ * Enable functions that use POSIX threads and C11 atomics (link with -lpthread).
+ */
+// #define BMP_L1_USE_PTHREAD
 
 #define BMP_L1_WHITE            ((uint8_t)1)
 #define BMP_L1_BLACK            ((uint8_t)0)
 
+#define BMP_L1_BOTTOM_UP        ((uint8_t)0)    // row order of BMP_L1_createEx
+#define BMP_L1_TOP_DOWN         ((uint8_t)1)
+
+#define BMP_L1_WARP_NEAREST     ((uint8_t)0)    // sampling mode of BMP_L1_warpAffine
+#define BMP_L1_WARP_AREA        ((uint8_t)1)
+
 /* Exported function macro ---------------------------------------------------*/
 /* Exported types ------------------------------------------------------------*/
 typedef void * (*BMP_L1_Malloc_Function)(size_t);
 typedef void   (*BMP_L1_free_Function)(void *);
 
+/**
+ * Receives one rendered band of a display list.
+ * pband is a BMP L1 image holding canvas rows [y, y + BMP_L1_getHeight(pband)).
+ * Return 0 to continue, otherwise rendering is aborted.
+ */
+typedef int    (*BMP_L1_band_Function)(void *ctx, uint8_t *pband, uint32_t y);
+
+/**
+ * Receives encoded output of BMP_L1_writePBM() / BMP_L1_writePNG().
+ * Return 0 on success, otherwise encoding is aborted.
+ */
+typedef int    (*BMP_L1_write_Function)(void *ctx, const uint8_t *data, uint32_t size);
+
+/** Display list (opaque). */
+typedef struct BMP_L1_dlist BMP_L1_dlist_st;
+
+/**
+ * Renders one batch job into pbmp, a cleared (black) image of the job's size.
+ * Return 0 on success.
+ */
+typedef int    (*BMP_L1_render_Function)(void *ctx, uint8_t *pbmp);
+
+/**
+ * Receives the result of batch job `index`, in submission order.
+ * pbmp is NULL when the job failed. It is reused after return, so copy or write it out here.
+ * Return 0 to continue, otherwise the batch is aborted.
+ */
+typedef int    (*BMP_L1_result_Function)(void *ctx, uint32_t index, uint8_t *pbmp);
+
 /* Exported enum tag ---------------------------------------------------------*/
+#ifdef BMP_L1_ENABLE_STATS
+typedef enum
+{
+    BMP_L1_API_CREATE = 0,
+    BMP_L1_API_FREE,
+    BMP_L1_API_SETPIXEL,
+    BMP_L1_API_GETPIXEL,
+    BMP_L1_API_DRAWLINE,
+    BMP_L1_API_DRAWRECT,
+    BMP_L1_API_FILL,
+    BMP_L1_API_DRAWTEXT,
+    BMP_L1_API_COPY,
+    BMP_L1_API_RESIZE_BICUBIC,
+    BMP_L1_API_BLIT,
+    BMP_L1_API_DLIST_RENDER,
+    BMP_L1_API_RENDER_BATCH,
+    BMP_L1_API_EQUAL,
+    BMP_L1_API_DIFF,
+    BMP_L1_API_APPLY_PATCH,
+    BMP_L1_API_WRITE_PBM,
+    BMP_L1_API_WRITE_PNG,
+    BMP_L1_API_WARP_AFFINE,
+    BMP_L1_API_RESIZE_NEAREST,
+    BMP_L1_API_NUM
+} BMP_L1_api_e;
+#endif
+
 /* Exported struct/union tag -------------------------------------------------*/
+/** One job of BMP_L1_renderBatch(). */
+typedef struct
+{
+    BMP_L1_render_Function render;
+    void *ctx;          // passed to render
+    uint32_t width;     // image width  [pixel]
+    uint32_t height;    // image height [pixel]
+} BMP_L1_job_st;
+
+/** Options of BMP_L1_renderBatch(). */
+typedef struct
+{
+    uint32_t threads;                   // number of worker threads including the caller (0: 1)
+    BMP_L1_result_Function result;      // receives results in submission order
+    void *ctx;                          // passed to result and worker_init
+    void (*worker_init)(void *ctx, uint32_t worker);    // optional. Called on each worker thread before
+                                                        // its first job, e.g. to call BMP_L1_setThreadAllocFunc()
+} BMP_L1_batch_st;
+
+#ifdef BMP_L1_ENABLE_STATS
+typedef struct
+{
+    uint64_t calls;     // number of calls
+    uint64_t pixels;    // pixels visited
+    uint64_t bytes;     // image bytes read or written
+    uint64_t ticks;     // accumulated BMP_L1_STATS_CLOCK() ticks (0 if no clock)
+} BMP_L1_api_stats_st;
+
+typedef struct
+{
+    BMP_L1_api_stats_st api[BMP_L1_API_NUM];
+    uint64_t alloc_count;   // allocations through the malloc hook
+    uint64_t alloc_bytes;   // bytes requested through the malloc hook
+    uint64_t free_count;    // releases through the free hook
+} BMP_L1_stats_st;
+#endif
+
 /* Exported variables --------------------------------------------------------*/
 /** 
  * Font source : https://www.mikrocontroller.net/user/show/benedikt
@@ -106,13 +240,20 @@ extern const BMP_L1_font_st BMP_L1_FONT_32X53;
 
 /* Exported function prototypes ----------------------------------------------*/
 extern void		 BMP_L1_setAllocFunc(BMP_L1_Malloc_Function, BMP_L1_free_Function);
+#ifdef BMP_L1_USE_PTHREAD
+extern void      BMP_L1_setThreadAllocFunc(BMP_L1_Malloc_Function, BMP_L1_free_Function);
+#endif
 extern uint8_t * BMP_L1_create      (uint32_t, uint32_t);
+extern uint8_t * BMP_L1_createEx    (uint32_t, uint32_t, uint8_t);
 extern void      BMP_L1_free        (uint8_t *);
 extern uint32_t	 BMP_L1_getWidth    (uint8_t *);
 extern uint32_t  BMP_L1_getHeight   (uint8_t *);
 extern uint32_t  BMP_L1_getFileSize (uint8_t *);
 extern uint32_t  BMP_L1_getImageSize(uint8_t *);
 extern uint32_t  BMP_L1_getOffset   (uint8_t *);
+extern uint8_t   BMP_L1_isTopDown   (uint8_t *);
+extern uint32_t  BMP_L1_getStride   (uint8_t *);
+extern uint8_t * BMP_L1_getRow      (uint8_t *, uint32_t);
 extern void      BMP_L1_setPixel (uint8_t *, uint32_t, uint32_t, uint8_t);
 extern void      BMP_L1_getPixel (uint8_t *, uint32_t, uint32_t, uint8_t *);
 extern void      BMP_L1_drawLine (uint8_t *, int32_t, int32_t, int32_t, int32_t, uint8_t);
@@ -121,6 +262,31 @@ extern void      BMP_L1_fill     (uint8_t *, uint8_t);
 extern void      BMP_L1_drawText(uint8_t *, char *, BMP_L1_font_st, uint32_t, uint32_t, uint8_t);
 extern uint8_t * BMP_L1_copy        (uint8_t *);
 extern uint8_t * BMP_L1_resize_bicubic(uint8_t *, uint32_t, uint32_t);
+extern uint8_t * BMP_L1_resize_nearest(uint8_t *, uint32_t, uint32_t);
+extern uint8_t * BMP_L1_warpAffine   (uint8_t *, const float *, uint32_t, uint32_t, uint8_t);
+extern void      BMP_L1_blit         (uint8_t *, uint8_t *, int32_t, int32_t);
+extern uint8_t   BMP_L1_equal        (uint8_t *, uint8_t *);
+extern uint8_t * BMP_L1_diff         (uint8_t *, uint8_t *);
+extern uint32_t  BMP_L1_getPatchSize (uint8_t *);
+extern int       BMP_L1_applyPatch   (uint8_t *, uint8_t *, uint32_t);
+extern int       BMP_L1_writePBM     (uint8_t *, BMP_L1_write_Function, void *);
+extern int       BMP_L1_writePNG     (uint8_t *, BMP_L1_write_Function, void *);
+extern BMP_L1_dlist_st * BMP_L1_dlist_create(uint32_t, uint32_t);
+extern void      BMP_L1_dlist_free    (BMP_L1_dlist_st *);
+extern int       BMP_L1_dlist_drawLine(BMP_L1_dlist_st *, int32_t, int32_t, int32_t, int32_t, uint8_t);
+extern int       BMP_L1_dlist_drawRect(BMP_L1_dlist_st *, uint32_t, uint32_t, uint32_t, uint32_t, uint8_t);
+extern int       BMP_L1_dlist_fill    (BMP_L1_dlist_st *, uint8_t);
+extern int       BMP_L1_dlist_drawText(BMP_L1_dlist_st *, char *, BMP_L1_font_st, uint32_t, uint32_t, uint8_t);
+extern int       BMP_L1_dlist_blit    (BMP_L1_dlist_st *, uint8_t *, int32_t, int32_t);
+extern int       BMP_L1_dlist_render  (BMP_L1_dlist_st *, uint32_t, BMP_L1_band_Function, void *);
+#ifdef BMP_L1_USE_PTHREAD
+extern int       BMP_L1_dlist_renderParallel(BMP_L1_dlist_st *, uint32_t, uint32_t, BMP_L1_band_Function, void *);
+extern int       BMP_L1_renderBatch(const BMP_L1_job_st *, uint32_t, const BMP_L1_batch_st *);
+#endif
+#ifdef BMP_L1_ENABLE_STATS
+extern void      BMP_L1_getStats  (BMP_L1_stats_st *);
+extern void      BMP_L1_resetStats(void);
+#endif
 
 #ifdef __cplusplus
 }
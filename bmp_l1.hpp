@@ -0,0 +1,314 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef _BMP_L1_HPP_
+#define _BMP_L1_HPP_
+
+/**
+ * Header-only C++ front end of the BMP L1 library (C++11 or later).
+ *
+ * bmp_l1::Bitmap<W, H> holds a complete BMP file (header + pixels) whose
+ * dimensions are compile-time constants, so row stride and pixel addresses
+ * constant-fold and glyph/fill loops can be unrolled by the compiler.
+ * bmp_l1::BitmapView wraps any existing image (from BMP_L1_create, a
+ * Bitmap<W, H> or a caller-provided arena) with runtime dimensions.
+ * Both expose data(), which can be passed to the C API without copying.
+ *
+ * Images that were not created by BMP_L1_create must not be passed to BMP_L1_free.
+ */
+
+/* Include system header files -----------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Include user header files -------------------------------------------------*/
+#include "bmp_l1.h"
+
+namespace bmp_l1 {
+
+/* Exported constants --------------------------------------------------------*/
+static constexpr uint32_t kHeaderSize = 14 + 40 + 2 * 4;    // file header + info header + palette
+
+/* Exported constexpr functions ----------------------------------------------*/
+/** Number of bytes of a single image row (always a multiple of 4). */
+constexpr uint32_t strideOf(uint32_t width)             { return ((width + 31) >> 5) << 2; }
+// Rows are padded to 32 bits as in every BMP file; BMP_L1_getStride() must agree (checked by test.c).
+static_assert(strideOf(1) == 4 && strideOf(32) == 4 && strideOf(33) == 8 && strideOf(128) == 16 && strideOf(512) == 64,
+              "strideOf must round rows up to a multiple of 32 bits");
+/** Number of bytes of the pixel area. */
+constexpr uint32_t imageSizeOf(uint32_t width, uint32_t height) { return strideOf(width) * height; }
+/** Number of bytes of the whole file (= BMP_L1_getFileSize). */
+constexpr uint32_t fileSizeOf(uint32_t width, uint32_t height)  { return kHeaderSize + imageSizeOf(width, height); }
+
+namespace detail {
+
+constexpr uint8_t le(uint32_t v, uint32_t i) { return (uint8_t)(v >> (8 * i)); }
+
+// Byte i of the header written by BMP_L1_createEx(width, height, topDown ? BMP_L1_TOP_DOWN : BMP_L1_BOTTOM_UP).
+constexpr uint8_t headerByte(uint32_t width, uint32_t height, uint32_t i, bool topDown = false)
+{
+    return i ==  0 ? (uint8_t)'B'
+         : i ==  1 ? (uint8_t)'M'
+         : i <   6 ? le(fileSizeOf(width, height), i - 2)     // File Size
+         : i <  10 ? 0                                         // Reserved1, Reserved2
+         : i <  14 ? le(kHeaderSize, i - 10)                   // Offset
+         : i <  18 ? le(40, i - 14)                            // HeaderSize
+         : i <  22 ? le(width, i - 18)                         // width
+         : i <  26 ? le(topDown ? 0u - height : height, i - 22) // height (negative: top-down)
+         : i == 26 ? 1                                         // planes
+         : i == 28 ? 1                                         // Bit count
+         : i <  34 ? 0                                         // Bit compression
+         : i <  38 ? le(imageSizeOf(width, height), i - 34)    // Image size
+         : i <  46 ? 0                                         // X/Y pixels per meter
+         : i <  50 ? le(2, i - 46)                             // Color index
+         : i <  58 ? 0                                         // Important index, Black
+         : i <  61 ? 0xFF                                      // White
+         : 0;
+}
+
+// Compile-time index list 0, 1, ..., N - 1 (std::make_index_sequence is C++14).
+template <uint32_t... I> struct Indices {};
+template <uint32_t N, uint32_t... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template <uint32_t... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+inline void writeHeader(uint8_t *pbmp, uint32_t width, uint32_t height, bool topDown = false)
+{
+    for (uint32_t i = 0; i < kHeaderSize; i++)
+        pbmp[i] = headerByte(width, height, i, topDown);
+}
+
+inline uint32_t read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+} // namespace detail
+
+/* Exported classes ----------------------------------------------------------*/
+/**
+ * Drawing members shared by Bitmap and BitmapView.
+ * Derived must provide data(), width(), height(), stride() and topDown().
+ */
+template <class Derived>
+class Canvas
+{
+public:
+    /** Pointer to the first byte of row y (0 = top) in either row order. */
+    uint8_t *row(uint32_t y)
+    {
+        return self().data() + kHeaderSize + self().stride() * (self().topDown() ? y : self().height() - y - 1);
+    }
+    const uint8_t *row(uint32_t y) const
+    {
+        return self().data() + kHeaderSize + self().stride() * (self().topDown() ? y : self().height() - y - 1);
+    }
+
+    /** Set a pixel. Out of range coordinates are ignored. */
+    void set(uint32_t x, uint32_t y, uint8_t isWhite)
+    {
+        if (x >= self().width() || y >= self().height())
+            return;
+        uint8_t *pBuf = row(y) + (x >> 3);
+        if (isWhite & 0x01)
+            *pBuf |=  (uint8_t)(0x80 >> (x & 0x07));
+        else
+            *pBuf &= (uint8_t)~(0x80 >> (x & 0x07));
+    }
+
+    /** Get a pixel. Returns BMP_L1_WHITE or BMP_L1_BLACK (BMP_L1_BLACK when out of range). */
+    uint8_t get(uint32_t x, uint32_t y) const
+    {
+        if (x >= self().width() || y >= self().height())
+            return BMP_L1_BLACK;
+        return (row(y)[x >> 3] >> (7 - (x & 0x07))) & 0x01;
+    }
+
+    /** Fill the horizontal span [x0, x1] of row y. Coordinates are clipped to the image. */
+    void span(uint32_t x0, uint32_t x1, uint32_t y, uint8_t isWhite)
+    {
+        if (x0 > x1)
+        {
+            uint32_t swap = x0;
+            x0 = x1;
+            x1 = swap;
+        }
+        if (y >= self().height() || x0 >= self().width())
+            return;
+        if (x1 >= self().width())
+            x1 = self().width() - 1;
+
+        uint8_t *pRow = row(y);
+        uint32_t b0 = x0 >> 3, b1 = x1 >> 3;
+        uint8_t m0 = (uint8_t)(0xFF >> (x0 & 0x07));
+        uint8_t m1 = (uint8_t)(0xFF << (7 - (x1 & 0x07)));
+        uint8_t fill = (isWhite & 0x01) ? 0xFF : 0x00;
+        if (b0 == b1)
+        {
+            uint8_t m = m0 & m1;
+            pRow[b0] = (uint8_t)((pRow[b0] & ~m) | (fill & m));
+            return;
+        }
+        pRow[b0] = (uint8_t)((pRow[b0] & ~m0) | (fill & m0));
+        memset(pRow + b0 + 1, fill, b1 - b0 - 1);
+        pRow[b1] = (uint8_t)((pRow[b1] & ~m1) | (fill & m1));
+    }
+
+    /** Fill a rectangle [x0, x1] x [y0, y1]. Coordinates are clipped to the image. */
+    void rect(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint8_t isWhite)
+    {
+        if (y0 > y1)
+        {
+            uint32_t swap = y0;
+            y0 = y1;
+            y1 = swap;
+        }
+        if (y1 >= self().height())
+            y1 = self().height() - 1;
+        for (uint32_t y = y0; y <= y1 && y < self().height(); y++)
+            span(x0, x1, y, isWhite);
+    }
+
+    /** Fill the whole image. Row padding is kept zero. */
+    void fill(uint8_t isWhite)
+    {
+        for (uint32_t y = 0; y < self().height(); y++)
+            span(0, self().width() - 1, y, isWhite);
+    }
+
+    /**
+     * Draw a glyph of compile-time size CW x CH, stored like the library fonts
+     * (rows of ceil(CW/8) bytes, last byte holds the leftmost pixels).
+     * Only set bits are drawn.
+     */
+    template <int CW, int CH>
+    void glyph(const uint8_t *pGlyph, uint32_t x, uint32_t y, uint8_t isWhite)
+    {
+        static constexpr int bytesPerRow = (CW + 7) / 8;
+        for (int yTxt = 0; yTxt < CH; yTxt++)
+        {
+            const uint8_t *pSrc = pGlyph + yTxt * bytesPerRow;
+            for (int xTxt = 0; xTxt < CW; xTxt++)
+            {
+                if (pSrc[(bytesPerRow - 1) - (xTxt >> 3)] & (0x80 >> (xTxt & 0x07)))
+                    set(x + xTxt, y + yTxt, isWhite);
+            }
+        }
+    }
+
+    /** Draw text with a library font. Same behaviour as BMP_L1_drawText. */
+    void text(const char *str, const BMP_L1_font_st &font, uint32_t x, uint32_t y, uint8_t isWhite)
+    {
+        int bytesPerChar = (font.char_width + 7) / 8;
+        for (uint32_t i = 0; str[i] != '\0'; i++)
+        {
+            const uint8_t *pGlyph = font.p + (uint8_t)str[i] * bytesPerChar * font.char_height;
+            for (int yTxt = 0; yTxt < font.char_height; yTxt++)
+            {
+                for (int xTxt = 0; xTxt < font.char_width; xTxt++)
+                {
+                    if (pGlyph[yTxt * bytesPerChar + (bytesPerChar - 1) - (xTxt >> 3)] & (0x80 >> (xTxt & 0x07)))
+                        set(x + i * font.char_width + xTxt, y + yTxt, isWhite);
+                }
+            }
+        }
+    }
+
+private:
+    Derived &self() { return *static_cast<Derived *>(this); }
+    const Derived &self() const { return *static_cast<const Derived *>(this); }
+};
+
+/**
+ * Runtime-sized view of an image in BMP L1 format. Does not own the memory.
+ */
+class BitmapView : public Canvas<BitmapView>
+{
+public:
+    /** Wrap an existing image (e.g. the result of BMP_L1_create or BMP_L1_createEx). */
+    explicit BitmapView(uint8_t *pbmp)
+        : pbmp_(pbmp),
+          width_(detail::read32(pbmp + 14 + 0x04)),
+          height_(detail::read32(pbmp + 14 + 0x08)),
+          stride_(strideOf(width_)),
+          topDown_((int32_t)height_ < 0)
+    {
+        if (topDown_)
+            height_ = 0u - height_;
+    }
+
+    /**
+     * Lay out a new image in a caller-provided buffer (static storage or an arena)
+     * of at least fileSizeOf(width, height) bytes. Pixels are cleared to black.
+     */
+    static BitmapView init(void *buf, uint32_t width, uint32_t height, bool topDown = false)
+    {
+        uint8_t *pbmp = static_cast<uint8_t *>(buf);
+        detail::writeHeader(pbmp, width, height, topDown);
+        memset(pbmp + kHeaderSize, 0, imageSizeOf(width, height));
+        return BitmapView(pbmp);
+    }
+
+    uint8_t *data()             { return pbmp_; }
+    const uint8_t *data() const { return pbmp_; }
+    uint32_t width() const      { return width_; }
+    uint32_t height() const     { return height_; }
+    uint32_t stride() const     { return stride_; }
+    bool topDown() const        { return topDown_; }
+    uint32_t fileSize() const   { return fileSizeOf(width_, height_); }
+
+private:
+    uint8_t *pbmp_;
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t stride_;
+    bool topDown_;
+};
+
+/**
+ * Image with compile-time dimensions and inline storage.
+ * Declare it static, on the stack, or construct it in an arena with placement new
+ * (sizeof(Bitmap<W, H>) == Bitmap<W, H>::kFileSize).
+ * With TopDown = true rows are stored top-down (negative height), so row(y)
+ * is a compile-time offset of data() and the pixel area streams forward.
+ */
+template <uint32_t W, uint32_t H, bool TopDown = false>
+class Bitmap : public Canvas<Bitmap<W, H, TopDown> >
+{
+    static_assert(W > 0 && H > 0, "Bitmap dimensions must be non-zero");
+
+public:
+    static constexpr uint32_t kWidth     = W;
+    static constexpr uint32_t kHeight    = H;
+    static constexpr uint32_t kStride    = strideOf(W);
+    static constexpr uint32_t kImageSize = imageSizeOf(W, H);
+    static constexpr uint32_t kFileSize  = fileSizeOf(W, H);
+
+    /**
+     * Storage is constant-initialized: the header bytes are compile-time constants
+     * and pixels are zero (black), so a static Bitmap needs no code at startup.
+     */
+    constexpr Bitmap() : Bitmap(typename detail::MakeIndices<kHeaderSize>::type()) {}
+
+    uint8_t *data()                       { return data_; }
+    constexpr const uint8_t *data() const { return data_; }
+    static constexpr uint32_t width()     { return W; }
+    static constexpr uint32_t height()    { return H; }
+    static constexpr uint32_t stride()    { return kStride; }
+    static constexpr bool topDown()       { return TopDown; }
+    static constexpr uint32_t fileSize()  { return kFileSize; }
+
+    /** Runtime view of this image, for code that is not templated on the size. */
+    BitmapView view() { return BitmapView(data_); }
+    operator BitmapView() { return view(); }
+
+private:
+    template <uint32_t... I>
+    constexpr explicit Bitmap(detail::Indices<I...>) : data_{detail::headerByte(W, H, I, TopDown)...} {}
+
+    uint8_t data_[kFileSize];
+};
+
+} // namespace bmp_l1
+
+#endif /* _BMP_L1_HPP_ */
+
+/***************************************************************END OF FILE****/
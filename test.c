@@ -1,7 +1,720 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "bmp_l1.h"
 
+// Rows are padded to 32 bits, the same as strideOf() in bmp_l1.hpp
+static int test_stride(void)
+{
+  for (uint32_t width = 1; width <= 1100; width++) {
+    uint8_t *pbmp = BMP_L1_create(width, 3);
+    uint32_t stride = ((width + 31) / 32) * 4;
+    if (pbmp == NULL) {
+      printf("Failed to create image\n");
+      return -1;
+    }
+    if (BMP_L1_getStride(pbmp) != stride || BMP_L1_getFileSize(pbmp) != 62 + stride * 3) {
+      printf("Wrong stride of width %u\n", (unsigned)width);
+      BMP_L1_free(pbmp);
+      return -1;
+    }
+    BMP_L1_free(pbmp);
+  }
+  return 0;
+}
+
+// Band sink of test_dlist: copy each band into the canvas
+static int copy_band(void *ctx, uint8_t *pband, uint32_t y)
+{
+  uint8_t *pbmp = (uint8_t *)ctx;
+  for (uint32_t i = 0; i < BMP_L1_getHeight(pband); i++)
+    memcpy(BMP_L1_getRow(pbmp, y + i), BMP_L1_getRow(pband, i), BMP_L1_getStride(pband));
+  return 0;
+}
+
+// A display list renders the same image as drawing directly, for any band height
+static int test_dlist(void)
+{
+  const uint32_t width = 203, height = 157;
+  uint8_t *pbmp = BMP_L1_create(width, height);
+  uint8_t *pbmp_band = BMP_L1_create(width, height);
+  uint8_t *pbmp_stamp = BMP_L1_create(37, 23);
+  BMP_L1_dlist_st *dl = BMP_L1_dlist_create(width, height);
+  int ret = 0;
+
+  if (pbmp == NULL || pbmp_band == NULL || pbmp_stamp == NULL || dl == NULL) {
+    printf("Failed to create display list\n");
+    return -1;
+  }
+  BMP_L1_fill(pbmp_stamp, BMP_L1_WHITE);
+  BMP_L1_drawLine(pbmp_stamp, 0, 0, 36, 22, BMP_L1_BLACK);
+
+  // Text crossing the bottom edge keeps drawing the following characters
+  BMP_L1_fill(pbmp, BMP_L1_WHITE);
+  BMP_L1_drawText(pbmp, "ABC", BMP_L1_FONT_6X10, 0, height - 3, BMP_L1_BLACK);
+  uint8_t color = BMP_L1_WHITE;
+  for (uint32_t x = 12; x < 18; x++)
+    for (uint32_t y = height - 3; y < height; y++) {
+      uint8_t pixel;
+      BMP_L1_getPixel(pbmp, x, y, &pixel);
+      color &= pixel;
+    }
+  if (color != BMP_L1_BLACK) {
+    printf("Failed to draw text at the bottom edge\n");
+    ret = -1;
+  }
+
+  srand(1);
+  BMP_L1_fill(pbmp, BMP_L1_WHITE);
+  BMP_L1_dlist_fill(dl, BMP_L1_WHITE);
+  for (int i = 0; i < 300; i++) {
+    int32_t x0 = rand() % (width + 20) - 10, y0 = rand() % (height + 20) - 10;
+    uint32_t x1 = rand() % width, y1 = rand() % height;
+    uint8_t isWhite = rand() % 2;
+    switch (rand() % 4) {
+    case 0:
+      BMP_L1_drawLine(pbmp, x0, y0, x1, y1, isWhite);
+      BMP_L1_dlist_drawLine(dl, x0, y0, x1, y1, isWhite);
+      break;
+    case 1:
+      BMP_L1_drawRect(pbmp, x0 < 0 ? 0 : x0, y0 < 0 ? 0 : y0, x1, y1, isWhite);
+      BMP_L1_dlist_drawRect(dl, x0 < 0 ? 0 : x0, y0 < 0 ? 0 : y0, x1, y1, isWhite);
+      break;
+    case 2:
+      BMP_L1_drawText(pbmp, "Hello!", BMP_L1_FONT_6X10, x1, y1, isWhite);
+      BMP_L1_dlist_drawText(dl, "Hello!", BMP_L1_FONT_6X10, x1, y1, isWhite);
+      break;
+    default:
+      BMP_L1_blit(pbmp, pbmp_stamp, x0 - 20, y0 - 10);
+      BMP_L1_dlist_blit(dl, pbmp_stamp, x0 - 20, y0 - 10);
+      break;
+    }
+  }
+
+  // 100 band heights, serial and parallel
+  for (uint32_t band_height = 1; band_height <= 100 && ret == 0; band_height++) {
+    uint32_t h = band_height < 90 ? band_height : band_height + (band_height - 90) * 8;
+    memset(BMP_L1_getRow(pbmp_band, height - 1), 0, BMP_L1_getImageSize(pbmp_band));
+    if (BMP_L1_dlist_render(dl, h, copy_band, pbmp_band) != 0 || !BMP_L1_equal(pbmp, pbmp_band)) {
+      printf("Display list differs with band height %u\n", (unsigned)h);
+      ret = -1;
+    }
+#ifdef BMP_L1_USE_PTHREAD
+    memset(BMP_L1_getRow(pbmp_band, height - 1), 0, BMP_L1_getImageSize(pbmp_band));
+    if (BMP_L1_dlist_renderParallel(dl, h, 4, copy_band, pbmp_band) != 0 || !BMP_L1_equal(pbmp, pbmp_band)) {
+      printf("Parallel display list differs with band height %u\n", (unsigned)h);
+      ret = -1;
+    }
+#endif
+  }
+
+#if defined(BMP_L1_USE_PTHREAD) && defined(BMP_L1_ENABLE_STATS)
+  // Band images of the worker threads are counted on the calling thread
+  BMP_L1_stats_st stats;
+  BMP_L1_resetStats();
+  BMP_L1_dlist_renderParallel(dl, 16, 4, copy_band, pbmp_band);
+  BMP_L1_getStats(&stats);
+  if (stats.alloc_count != stats.free_count || stats.alloc_count < 2) {
+    printf("Wrong statistics of parallel rendering\n");
+    ret = -1;
+  }
+#endif
+
+  BMP_L1_dlist_free(dl);
+  BMP_L1_free(pbmp);
+  BMP_L1_free(pbmp_band);
+  BMP_L1_free(pbmp_stamp);
+  return ret;
+}
+
+// Random lines and rectangles of test_patch
+static void draw_random(uint8_t *pbmp, int count)
+{
+  uint32_t width = BMP_L1_getWidth(pbmp), height = BMP_L1_getHeight(pbmp);
+  for (int i = 0; i < count; i++) {
+    uint32_t x0 = rand() % width, y0 = rand() % height, x1 = rand() % width, y1 = rand() % height;
+    if (rand() % 2)
+      BMP_L1_drawLine(pbmp, x0, y0, x1, y1, rand() % 2);
+    else
+      BMP_L1_drawRect(pbmp, x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0, rand() % 2);
+  }
+}
+
+// A patch turns the old image into the new one, and a truncated patch is rejected
+static int test_patch(void)
+{
+  srand(2);
+  for (int i = 0; i < 300; i++) {
+    uint32_t width = 1 + rand() % 150, height = 1 + rand() % 80;
+    uint8_t *pbmpA = BMP_L1_create(width, height);
+    draw_random(pbmpA, 10);
+    uint8_t *pbmpB = BMP_L1_copy(pbmpA);
+    draw_random(pbmpB, rand() % 4);
+    uint8_t *pbmp = BMP_L1_copy(pbmpA);
+    uint8_t *patch = BMP_L1_diff(pbmpA, pbmpB);
+    if (pbmpA == NULL || pbmpB == NULL || pbmp == NULL || patch == NULL) {
+      printf("Failed to create patch\n");
+      return -1;
+    }
+    uint32_t size = BMP_L1_getPatchSize(patch);
+    if (BMP_L1_applyPatch(pbmp, patch, size) != 0 || !BMP_L1_equal(pbmp, pbmpB)) {
+      printf("Patch differs with %ux%u\n", (unsigned)width, (unsigned)height);
+      return -1;
+    }
+
+    // Cut the patch short, also in its own header, into a buffer of exactly that size
+    uint32_t len = rand() % size;
+    uint8_t *cut = malloc(len > 0 ? len : 1);
+    memcpy(cut, patch, len);
+    if (len >= 8)
+      for (int b = 0; b < 4; b++)
+        cut[4 + b] = (uint8_t)(len >> (8 * b));
+    if (BMP_L1_applyPatch(pbmp, cut, len) != -1 || BMP_L1_applyPatch(pbmp, patch, size - 1) != -1) {
+      printf("Truncated patch was applied\n");
+      return -1;
+    }
+    free(cut);
+    BMP_L1_free(patch);
+    BMP_L1_free(pbmp);
+    BMP_L1_free(pbmpB);
+    BMP_L1_free(pbmpA);
+  }
+  return 0;
+}
+
+// Output buffer of test_encode
+typedef struct {
+  uint8_t *data;
+  uint32_t size;
+  uint32_t capacity;
+} buffer_t;
+
+static int write_buffer(void *ctx, const uint8_t *data, uint32_t size)
+{
+  buffer_t *buf = (buffer_t *)ctx;
+  if (buf->size + size > buf->capacity)
+    return -1;
+  memcpy(buf->data + buf->size, data, size);
+  buf->size += size;
+  return 0;
+}
+
+// Bit reader of inflate_fixed
+typedef struct {
+  const uint8_t *p;
+  uint32_t len, pos;
+} bits_t;
+
+static uint32_t get_bits(bits_t *in, uint32_t n)
+{
+  uint32_t v = 0;
+  for (uint32_t i = 0; i < n; i++, in->pos++)
+    if (in->pos < in->len * 8)
+      v |= (uint32_t)((in->p[in->pos >> 3] >> (in->pos & 7)) & 1) << i;
+  return v;
+}
+
+// Minimal zlib decoder for stored and fixed Huffman blocks. Returns the output size, or -1
+static long inflate_fixed(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap)
+{
+  static const uint16_t lbase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                     35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const uint16_t dbase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                     257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+  bits_t in = { src, len, 16 };
+  uint32_t n = 0, final;
+
+  if (len < 6 || (src[0] & 0x0F) != 8 || ((src[0] << 8) | src[1]) % 31 != 0)
+    return -1;
+  do {
+    final = get_bits(&in, 1);
+    uint32_t type = get_bits(&in, 2);
+    if (type == 0) {
+      in.pos = (in.pos + 7) & ~7u;
+      uint32_t size = get_bits(&in, 16);
+      if (get_bits(&in, 16) != (~size & 0xFFFF) || in.pos / 8 + size > len || n + size > cap)
+        return -1;
+      memcpy(dst + n, src + in.pos / 8, size);
+      in.pos += size * 8;
+      n += size;
+    } else if (type == 1) {
+      for (;;) {
+        uint32_t code = 0, symbol, bits;
+        for (bits = 1; bits <= 9; bits++) {
+          code = (code << 1) | get_bits(&in, 1);
+          if (bits == 7 && code <= 0x17) { symbol = 256 + code; break; }
+          if (bits == 8 && code >= 0x30 && code <= 0xBF) { symbol = code - 0x30; break; }
+          if (bits == 8 && code >= 0xC0 && code <= 0xC7) { symbol = 280 + code - 0xC0; break; }
+          if (bits == 9) { symbol = 144 + code - 0x190; break; }
+        }
+        if (in.pos > len * 8)
+          return -1;
+        if (symbol < 256) {
+          if (n >= cap)
+            return -1;
+          dst[n++] = (uint8_t)symbol;
+          continue;
+        }
+        if (symbol == 256)
+          break;
+        uint32_t l = symbol - 257, d = 0;
+        if (l >= 29)
+          return -1;
+        uint32_t length = lbase[l] + get_bits(&in, l >= 8 && l < 28 ? (l - 4) / 4 : 0);
+        for (uint32_t i = 0; i < 5; i++)
+          d = (d << 1) | get_bits(&in, 1);
+        if (d >= 30)
+          return -1;
+        uint32_t distance = dbase[d] + get_bits(&in, d >= 4 ? (d - 2) / 2 : 0);
+        if (distance > n || n + length > cap)
+          return -1;
+        for (uint32_t i = 0; i < length; i++, n++)
+          dst[n] = dst[n - distance];
+      }
+    } else {
+      return -1;
+    }
+  } while (!final);
+
+  // Adler-32 of the decoded data
+  uint32_t a = 1, b = 0, pos = (in.pos + 7) / 8;
+  for (uint32_t i = 0; i < n; i++) {
+    a = (a + dst[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  if (pos + 4 > len || (((uint32_t)src[pos] << 24) | ((uint32_t)src[pos + 1] << 16) | ((uint32_t)src[pos + 2] << 8) | src[pos + 3]) != ((b << 16) | a))
+    return -1;
+  return (long)n;
+}
+
+static uint32_t read_be(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// PBM and PNG output decode back to the image, and noise costs little more than its raw size in PNG
+static int test_encode(void)
+{
+  buffer_t buf;
+  uint8_t *zdata, *raw;
+
+  buf.capacity = 1 << 20;
+  buf.data = malloc(buf.capacity);
+  zdata = malloc(buf.capacity);
+  raw = malloc(buf.capacity);
+  srand(3);
+  for (int i = 0; i < 10; i++) {
+    uint32_t width = i == 0 ? 512 : 1 + rand() % 300, height = i == 0 ? 440 : 1 + rand() % 200;
+    uint32_t bytes = (width + 7) / 8, zsize = 0, offset;
+    uint8_t *pbmp = BMP_L1_create(width, height);
+    uint8_t pixel;
+    if (pbmp == NULL) {
+      printf("Failed to create image\n");
+      return -1;
+    }
+    if (i % 2 == 0) {
+      for (uint32_t y = 0; y < height; y++)
+        for (uint32_t x = 0; x < bytes; x++)
+          BMP_L1_getRow(pbmp, y)[x] = (uint8_t)rand();
+    } else {
+      BMP_L1_fill(pbmp, BMP_L1_WHITE);
+      draw_random(pbmp, 20);
+    }
+
+    // PBM: header, then rows with 1 = black
+    buf.size = 0;
+    if (BMP_L1_writePBM(pbmp, write_buffer, &buf) != 0) {
+      printf("Failed to write PBM\n");
+      return -1;
+    }
+    offset = (uint32_t)snprintf((char *)raw, 64, "P4\n%u %u\n", (unsigned)width, (unsigned)height);
+    if (buf.size != offset + bytes * height || memcmp(buf.data, raw, offset) != 0) {
+      printf("Wrong PBM size of %ux%u\n", (unsigned)width, (unsigned)height);
+      return -1;
+    }
+    for (uint32_t y = 0; y < height; y++)
+      for (uint32_t x = 0; x < width; x++) {
+        BMP_L1_getPixel(pbmp, x, y, &pixel);
+        if (((buf.data[offset + y * bytes + x / 8] >> (7 - x % 8)) & 1) == pixel) {
+          printf("PBM differs at (%u, %u)\n", (unsigned)x, (unsigned)y);
+          return -1;
+        }
+      }
+
+    // PNG: collect IDAT chunks, inflate, then undo filters None and Up
+    buf.size = 0;
+    if (BMP_L1_writePNG(pbmp, write_buffer, &buf) != 0 || buf.size < 33 + 12
+        || read_be(buf.data + 16) != width || read_be(buf.data + 20) != height) {
+      printf("Failed to write PNG\n");
+      return -1;
+    }
+    for (offset = 33; offset + 12 <= buf.size; offset += 12 + read_be(buf.data + offset)) {
+      uint32_t size = read_be(buf.data + offset);
+      if (memcmp(buf.data + offset + 4, "IDAT", 4) == 0) {
+        memcpy(zdata + zsize, buf.data + offset + 8, size);
+        zsize += size;
+      }
+    }
+    if (inflate_fixed(zdata, zsize, raw, buf.capacity) != (long)((bytes + 1) * height)) {
+      printf("Failed to decode PNG of %ux%u\n", (unsigned)width, (unsigned)height);
+      return -1;
+    }
+    for (uint32_t y = 0; y < height; y++) {
+      uint8_t *row = raw + y * (bytes + 1);
+      if (row[0] == 2 && y > 0)
+        for (uint32_t x = 0; x < bytes; x++)
+          row[1 + x] = (uint8_t)(row[1 + x] + (row - (bytes + 1))[1 + x]);
+      else if (row[0] != 0) {
+        printf("Unexpected PNG filter %u\n", (unsigned)row[0]);
+        return -1;
+      }
+      for (uint32_t x = 0; x < width; x++) {
+        BMP_L1_getPixel(pbmp, x, y, &pixel);
+        if (((row[1 + x / 8] >> (7 - x % 8)) & 1) != pixel) {
+          printf("PNG differs at (%u, %u)\n", (unsigned)x, (unsigned)y);
+          return -1;
+        }
+      }
+    }
+    // Worst case: every block stored, 5 bytes each, in blocks of one literal per symbol
+    uint32_t block = (1u << BMP_L1_PNG_WINDOW_BITS) - 262;
+    if (block > BMP_L1_PNG_BLOCK_SYMBOLS - 1)
+      block = BMP_L1_PNG_BLOCK_SYMBOLS - 1;
+    zsize = (bytes + 1) * height;
+    zsize += 5 * (zsize / block + 1) + 6;
+    if (i == 0 && buf.size > 45 + zsize + 12 * (zsize / BMP_L1_PNG_IDAT_SIZE + 1)) {
+      printf("PNG of noise is %u bytes\n", (unsigned)buf.size);
+      return -1;
+    }
+    BMP_L1_free(pbmp);
+  }
+  free(raw);
+  free(zdata);
+  free(buf.data);
+  return 0;
+}
+
+// Identity and quarter turns map every pixel exactly, and an empty output is rejected
+static int test_warp(void)
+{
+  srand(4);
+  for (int i = 0; i < 20; i++) {
+    uint32_t width = 1 + rand() % 120, height = 1 + rand() % 90;
+    uint8_t *pbmp = BMP_L1_create(width, height);
+    BMP_L1_fill(pbmp, BMP_L1_WHITE);
+    draw_random(pbmp, 15);
+    for (uint8_t mode = BMP_L1_WARP_NEAREST; mode <= BMP_L1_WARP_AREA; mode++) {
+      const float identity[6] = {1, 0, 0, 0, 1, 0};
+      const float rotate[6] = {0, -1, (float)height, 1, 0, 0};   // (x, y) -> (height - y, x)
+      uint8_t *pbmpId = BMP_L1_warpAffine(pbmp, identity, width, height, mode);
+      uint8_t *pbmpRot = BMP_L1_warpAffine(pbmp, rotate, height, width, mode);
+      if (pbmpId == NULL || pbmpRot == NULL || !BMP_L1_equal(pbmp, pbmpId)) {
+        printf("Identity warp differs with %ux%u\n", (unsigned)width, (unsigned)height);
+        return -1;
+      }
+      for (uint32_t y = 0; y < height; y++)
+        for (uint32_t x = 0; x < width; x++) {
+          uint8_t pixel, rotated;
+          BMP_L1_getPixel(pbmp, x, y, &pixel);
+          BMP_L1_getPixel(pbmpRot, height - 1 - y, x, &rotated);
+          if (pixel != rotated) {
+            printf("Rotated warp differs at (%u, %u)\n", (unsigned)x, (unsigned)y);
+            return -1;
+          }
+        }
+      if (BMP_L1_warpAffine(pbmp, identity, 0, height, mode) != NULL
+          || BMP_L1_warpAffine(pbmp, identity, width, 0, mode) != NULL) {
+        printf("Empty warp was created\n");
+        return -1;
+      }
+      BMP_L1_free(pbmpId);
+      BMP_L1_free(pbmpRot);
+    }
+    BMP_L1_free(pbmp);
+  }
+  return 0;
+}
+
+// Nearest resize picks the source pixel under each pixel center, with or without the byte spread tables
+static int test_resize_nearest(void)
+{
+  srand(6);
+  for (int i = 0; i < 300; i++) {
+    uint32_t src_width = 1 + rand() % 100, src_height = 1 + rand() % 60;
+    uint32_t width = i % 2 ? src_width * (1 + rand() % 8) : (uint32_t)(1 + rand() % 300), height = 1 + rand() % 120;
+    uint8_t *pbmp = BMP_L1_create(src_width, src_height);
+    // Random bits, also in the row padding, which must not leak into the result
+    for (uint32_t y = 0; y < src_height; y++)
+      for (uint32_t x = 0; x < BMP_L1_getStride(pbmp); x++)
+        BMP_L1_getRow(pbmp, y)[x] = (uint8_t)rand();
+    uint8_t *pbmp_resize = BMP_L1_resize_nearest(pbmp, width, height);
+    if (pbmp_resize == NULL || BMP_L1_getWidth(pbmp_resize) != width || BMP_L1_getHeight(pbmp_resize) != height) {
+      printf("Failed to resize %ux%u to %ux%u\n", (unsigned)src_width, (unsigned)src_height, (unsigned)width, (unsigned)height);
+      return -1;
+    }
+    for (uint32_t y = 0; y < height; y++) {
+      uint8_t *row = BMP_L1_getRow(pbmp_resize, y);
+      for (uint32_t x = 0; x < width; x++) {
+        uint8_t pixel, expected;
+        BMP_L1_getPixel(pbmp_resize, x, y, &pixel);
+        BMP_L1_getPixel(pbmp, (uint32_t)(((2 * (uint64_t)x + 1) * src_width) / (2 * (uint64_t)width)),
+                        (uint32_t)(((2 * (uint64_t)y + 1) * src_height) / (2 * (uint64_t)height)), &expected);
+        if (pixel != expected) {
+          printf("Nearest resize %ux%u to %ux%u differs at (%u, %u)\n", (unsigned)src_width, (unsigned)src_height,
+                 (unsigned)width, (unsigned)height, (unsigned)x, (unsigned)y);
+          return -1;
+        }
+      }
+      if ((width & 0x07) && (row[width >> 3] & (0xFF >> (width & 0x07))) != 0) {
+        printf("Nearest resize to %ux%u sets padding bits\n", (unsigned)width, (unsigned)height);
+        return -1;
+      }
+    }
+    BMP_L1_free(pbmp_resize);
+    BMP_L1_free(pbmp);
+  }
+  if (BMP_L1_resize_nearest(NULL, 1, 1) != NULL) {
+    printf("Resized a missing image\n");
+    return -1;
+  }
+  return 0;
+}
+
+// Same size and pixels, whatever the row order
+static int same_pixels(uint8_t *pbmpA, uint8_t *pbmpB)
+{
+  uint32_t width = BMP_L1_getWidth(pbmpA), height = BMP_L1_getHeight(pbmpA);
+  if (width != BMP_L1_getWidth(pbmpB) || height != BMP_L1_getHeight(pbmpB))
+    return 0;
+  for (uint32_t y = 0; y < height; y++)
+    for (uint32_t x = 0; x < width; x++) {
+      uint8_t a, b;
+      BMP_L1_getPixel(pbmpA, x, y, &a);
+      BMP_L1_getPixel(pbmpB, x, y, &b);
+      if (a != b)
+        return 0;
+    }
+  return 1;
+}
+
+// Same bytes from writePBM or writePNG for both images
+static int same_output(int (*write)(uint8_t *, BMP_L1_write_Function, void *), uint8_t *pbmpA, uint8_t *pbmpB)
+{
+  buffer_t bufA = { malloc(1 << 18), 0, 1 << 18 }, bufB = { malloc(1 << 18), 0, 1 << 18 };
+  int ret = write(pbmpA, write_buffer, &bufA) == 0 && write(pbmpB, write_buffer, &bufB) == 0
+            && bufA.size == bufB.size && memcmp(bufA.data, bufB.data, bufA.size) == 0;
+  free(bufA.data);
+  free(bufB.data);
+  return ret;
+}
+
+// Top-down images draw and convert exactly like bottom-up ones
+static int test_layout(void)
+{
+  const uint32_t width = 77, height = 53;
+  const float matrix[6] = {0.8f, -0.4f, 20.0f, 0.5f, 0.9f, -5.0f};
+  uint8_t *pbmp[2], *pstamp[2], *pold[2];
+  const char *name[] = {"setPixel", "drawLine", "drawRect", "fill", "drawText", "blit"};
+
+  srand(7);
+  for (int i = 0; i < 2; i++) {
+    uint8_t layout = i ? BMP_L1_TOP_DOWN : BMP_L1_BOTTOM_UP;
+    pbmp[i] = BMP_L1_createEx(width, height, layout);
+    pstamp[i] = BMP_L1_createEx(19, 11, layout);
+    // The first row in memory is the top row of a top-down image, the bottom row otherwise
+    if (pbmp[i] == NULL || pstamp[i] == NULL || BMP_L1_isTopDown(pbmp[i]) != i
+        || BMP_L1_getRow(pbmp[i], i ? 0 : height - 1) != pbmp[i] + BMP_L1_getOffset(pbmp[i])) {
+      printf("Failed to create image of layout %d\n", i);
+      return -1;
+    }
+    BMP_L1_fill(pbmp[i], BMP_L1_WHITE);
+    BMP_L1_fill(pstamp[i], BMP_L1_WHITE);
+    BMP_L1_drawLine(pstamp[i], 0, 0, 18, 10, BMP_L1_BLACK);
+    BMP_L1_drawRect(pstamp[i], 0, 0, 3, 2, BMP_L1_BLACK);
+  }
+  if (!same_pixels(pstamp[0], pstamp[1]) || BMP_L1_getStride(pbmp[0]) != BMP_L1_getStride(pbmp[1])) {
+    printf("Top-down stamp differs\n");
+    return -1;
+  }
+
+  // Every primitive, the same call on both layouts
+  for (int n = 0; n < 300; n++) {
+    uint32_t x0 = rand() % width, y0 = rand() % height, x1 = rand() % width, y1 = rand() % height;
+    int32_t bx = rand() % (width + 30) - 20, by = rand() % (height + 20) - 10;
+    uint8_t isWhite = rand() % 2, src = rand() % 2, rare = rand() % 8 == 0;
+    int op = rand() % 6;
+    if (n == 150) {
+      pold[0] = BMP_L1_copy(pbmp[0]);
+      pold[1] = BMP_L1_copy(pbmp[1]);
+    }
+    for (int i = 0; i < 2; i++) {
+      switch (op) {
+      case 0: BMP_L1_setPixel(pbmp[i], x0, y0, isWhite); break;
+      case 1: BMP_L1_drawLine(pbmp[i], x0, y0, x1, y1, isWhite); break;
+      case 2: BMP_L1_drawRect(pbmp[i], x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0, isWhite); break;
+      case 3: if (rare) BMP_L1_fill(pbmp[i], isWhite); break;
+      case 4: BMP_L1_drawText(pbmp[i], "Ag!", BMP_L1_FONT_6X10, x0, y0, isWhite); break;
+      default: BMP_L1_blit(pbmp[i], pstamp[src], bx, by); break;
+      }
+    }
+    if (!same_pixels(pbmp[0], pbmp[1])) {
+      printf("Top-down %s differs\n", name[op]);
+      return -1;
+    }
+  }
+
+  // Comparison and patches work across layouts, and patches do not depend on the layout
+  uint8_t *patch[2] = { BMP_L1_diff(pold[0], pbmp[0]), BMP_L1_diff(pold[1], pbmp[1]) };
+  if (!BMP_L1_equal(pbmp[0], pbmp[1]) || !BMP_L1_equal(pold[1], pold[0]) || BMP_L1_equal(pold[1], pbmp[0]) != BMP_L1_equal(pold[0], pbmp[0])
+      || patch[0] == NULL || patch[1] == NULL || BMP_L1_getPatchSize(patch[0]) != BMP_L1_getPatchSize(patch[1])
+      || memcmp(patch[0], patch[1], BMP_L1_getPatchSize(patch[0])) != 0) {
+    printf("Top-down comparison or patch differs\n");
+    return -1;
+  }
+  uint8_t *ptd = BMP_L1_createEx(width, height, BMP_L1_TOP_DOWN);
+  BMP_L1_blit(ptd, pold[0], 0, 0);
+  if (BMP_L1_applyPatch(ptd, patch[0], BMP_L1_getPatchSize(patch[0])) != 0 || !same_pixels(ptd, pbmp[0])) {
+    printf("Top-down patch applies differently\n");
+    return -1;
+  }
+
+  // Conversions give the same pixels and the same encoded files
+  uint8_t *pout[2][5];
+  for (int i = 0; i < 2; i++) {
+    pout[i][0] = BMP_L1_copy(pbmp[i]);
+    pout[i][1] = BMP_L1_resize_nearest(pbmp[i], 2 * width + 3, height / 2 + 1);
+    pout[i][2] = BMP_L1_resize_bicubic(pbmp[i], width + 20, height + 9);
+    pout[i][3] = BMP_L1_warpAffine(pbmp[i], matrix, width, height, BMP_L1_WARP_NEAREST);
+    pout[i][4] = BMP_L1_warpAffine(pbmp[i], matrix, width, height, BMP_L1_WARP_AREA);
+  }
+  for (int k = 0; k < 5; k++)
+    if (pout[0][k] == NULL || pout[1][k] == NULL || !same_pixels(pout[0][k], pout[1][k])) {
+      printf("Top-down conversion %d differs\n", k);
+      return -1;
+    }
+  if (!same_output(BMP_L1_writePBM, pbmp[0], pbmp[1]) || !same_output(BMP_L1_writePNG, pbmp[0], pbmp[1])) {
+    printf("Top-down PBM or PNG differs\n");
+    return -1;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    for (int k = 0; k < 5; k++)
+      BMP_L1_free(pout[i][k]);
+    BMP_L1_free(patch[i]);
+    BMP_L1_free(pold[i]);
+    BMP_L1_free(pstamp[i]);
+    BMP_L1_free(pbmp[i]);
+  }
+  BMP_L1_free(ptd);
+  return 0;
+}
+
+#ifdef BMP_L1_USE_PTHREAD
+// Job of test_batch: a rectangle as wide as the job index
+static int render_job(void *ctx, uint8_t *pbmp)
+{
+  uint32_t index = *(uint32_t *)ctx;
+  BMP_L1_fill(pbmp, BMP_L1_WHITE);
+  BMP_L1_drawRect(pbmp, 0, 0, index % BMP_L1_getWidth(pbmp), BMP_L1_getHeight(pbmp) - 1, BMP_L1_BLACK);
+  return 0;
+}
+
+// Result of test_batch: count results arriving in submission order with the right content
+static int check_result(void *ctx, uint32_t index, uint8_t *pbmp)
+{
+  uint32_t *next = (uint32_t *)ctx;
+  uint32_t width = BMP_L1_getWidth(pbmp), x = index % width;
+  uint8_t inside, outside = BMP_L1_WHITE;
+  BMP_L1_getPixel(pbmp, x, 0, &inside);
+  if (x + 1 < width)
+    BMP_L1_getPixel(pbmp, x + 1, 0, &outside);
+  if (index == *next && inside == BMP_L1_BLACK && outside == BMP_L1_WHITE)
+    (*next)++;
+  return 0;
+}
+
+// Each worker allocates through its own functions
+static void init_worker(void *ctx, uint32_t worker)
+{
+  (void)ctx;
+  (void)worker;
+  BMP_L1_setThreadAllocFunc(malloc, free);
+}
+
+// A batch hands out every result in submission order, with any number of workers
+static int test_batch(void)
+{
+  enum { JOBS = 200 };
+  BMP_L1_job_st jobs[JOBS];
+  uint32_t index[JOBS];
+  uint32_t next;
+  BMP_L1_batch_st batch = { 0, check_result, &next, init_worker };
+
+  for (uint32_t i = 0; i < JOBS; i++) {
+    index[i] = i;
+    jobs[i].render = render_job;
+    jobs[i].ctx = &index[i];
+    jobs[i].width = 8 + i % 61;
+    jobs[i].height = 1 + i % 13;
+  }
+  for (uint32_t threads = 1; threads <= 8; threads++) {
+#ifdef BMP_L1_ENABLE_STATS
+    BMP_L1_stats_st stats;
+    BMP_L1_resetStats();
+#endif
+    next = 0;
+    batch.threads = threads;
+    if (BMP_L1_renderBatch(jobs, JOBS, &batch) != 0 || next != JOBS) {
+      printf("Batch differs with %u threads\n", (unsigned)threads);
+      return -1;
+    }
+#ifdef BMP_L1_ENABLE_STATS
+    // Pools of the worker threads are counted on the calling thread
+    BMP_L1_getStats(&stats);
+    if (stats.alloc_count != stats.free_count || stats.alloc_count < 5) {
+      printf("Wrong statistics of batch rendering\n");
+      return -1;
+    }
+#endif
+  }
+  return 0;
+}
+#endif
+
+#ifdef BMP_L1_ENABLE_STATS
+// Nested calls are not counted twice, and every allocation is released
+static int test_stats(void)
+{
+  BMP_L1_stats_st stats;
+  uint8_t *pbmp, *pbmp_copy, *pbmp_resize;
+
+  BMP_L1_resetStats();
+  pbmp = BMP_L1_create(64, 32);
+  pbmp_copy = BMP_L1_copy(pbmp);
+  pbmp_resize = BMP_L1_resize_bicubic(pbmp, 32, 16);
+  if (pbmp == NULL || pbmp_copy == NULL || pbmp_resize == NULL) {
+    printf("Failed to create image\n");
+    return -1;
+  }
+  BMP_L1_getStats(&stats);
+  if (stats.api[BMP_L1_API_CREATE].calls != 1 || stats.api[BMP_L1_API_COPY].calls != 1
+      || stats.api[BMP_L1_API_RESIZE_BICUBIC].calls != 1 || stats.alloc_count != 3) {
+    printf("Wrong statistics of nested calls\n");
+    return -1;
+  }
+
+  BMP_L1_free(pbmp);
+  BMP_L1_free(pbmp_copy);
+  BMP_L1_free(pbmp_resize);
+  BMP_L1_getStats(&stats);
+  if (stats.free_count != stats.alloc_count || stats.api[BMP_L1_API_FREE].calls != 3) {
+    printf("Allocations and releases do not balance\n");
+    return -1;
+  }
+  return 0;
+}
+#endif
+
 int main(void)
 {
   FILE *fp;
@@ -66,5 +779,28 @@ int main(void)
 
   BMP_L1_free(pbmp);
   BMP_L1_free(pbmp_resize);
+
+  if (test_stride() != 0)
+    return -1;
+  if (test_dlist() != 0)
+    return -1;
+  if (test_patch() != 0)
+    return -1;
+  if (test_encode() != 0)
+    return -1;
+  if (test_warp() != 0)
+    return -1;
+  if (test_resize_nearest() != 0)
+    return -1;
+  if (test_layout() != 0)
+    return -1;
+#ifdef BMP_L1_USE_PTHREAD
+  if (test_batch() != 0)
+    return -1;
+#endif
+#ifdef BMP_L1_ENABLE_STATS
+  if (test_stats() != 0)
+    return -1;
+#endif
   return 0;
 }
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <string.h>
+#include "bmp_l1.hpp"
+
+using namespace bmp_l1;
+
+// The header is laid out at compile time
+constexpr Bitmap<33, 5, true> kConstBitmap;
+static_assert(kConstBitmap.data()[0] == 'B' && kConstBitmap.data()[18] == 33
+              && kConstBitmap.data()[22] == (uint8_t)(0u - 5) && kConstBitmap.data()[kHeaderSize] == 0,
+              "Bitmap header must be a compile-time constant");
+
+// Same file bytes as the C library
+static int same_file(const uint8_t *pbmp, uint8_t *pbmpC, const char *what)
+{
+  if (BMP_L1_getFileSize(pbmpC) != fileSizeOf(BMP_L1_getWidth(pbmpC), BMP_L1_getHeight(pbmpC))
+      || memcmp(pbmp, pbmpC, BMP_L1_getFileSize(pbmpC)) != 0) {
+    printf("%s differs from the C library at %ux%u%s\n", what, (unsigned)BMP_L1_getWidth(pbmpC),
+           (unsigned)BMP_L1_getHeight(pbmpC), BMP_L1_isTopDown(pbmpC) ? " top-down" : "");
+    return 0;
+  }
+  return 1;
+}
+
+// An empty Bitmap and BitmapView::init match BMP_L1_createEx, then draw alike through BitmapView
+template <uint32_t W, uint32_t H, bool TopDown>
+static int test_bitmap(void)
+{
+  static Bitmap<W, H, TopDown> bitmap;
+  static uint8_t buf[fileSizeOf(W, H)];
+  uint8_t *pbmpC = BMP_L1_createEx(W, H, TopDown ? BMP_L1_TOP_DOWN : BMP_L1_BOTTOM_UP);
+  int ret = 0;
+
+  if (pbmpC == NULL) {
+    printf("Failed to create image\n");
+    return -1;
+  }
+  BitmapView view = BitmapView::init(buf, W, H, TopDown);
+  if (!same_file(bitmap.data(), pbmpC, "Bitmap") || !same_file(buf, pbmpC, "BitmapView::init")
+      || view.stride() != BMP_L1_getStride(pbmpC) || view.row(0) != BMP_L1_getRow(pbmpC, 0) - pbmpC + buf)
+    ret = -1;
+
+  // Draw the same content through the view of a Bitmap and through the C API
+  BitmapView canvas = bitmap.view();
+  canvas.fill(BMP_L1_WHITE);
+  BMP_L1_fill(pbmpC, BMP_L1_WHITE);
+  for (uint32_t i = 0; i < 40; i++) {
+    uint32_t x0 = (i * 37) % W, y0 = (i * 11) % H, x1 = (i * 53 + 5) % W, y1 = (i * 7 + 3) % H;
+    uint8_t isWhite = i % 3 == 0;
+    canvas.rect(x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0, isWhite);
+    BMP_L1_drawRect(pbmpC, x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0, isWhite);
+    canvas.set(x1, y0, !isWhite);
+    BMP_L1_setPixel(pbmpC, x1, y0, !isWhite);
+  }
+  canvas.text("Hi!", BMP_L1_FONT_6X10, 0, 0, BMP_L1_BLACK);
+  BMP_L1_drawText(pbmpC, (char *)"Hi!", BMP_L1_FONT_6X10, 0, 0, BMP_L1_BLACK);
+  if (!same_file(bitmap.data(), pbmpC, "Drawing"))
+    ret = -1;
+  for (uint32_t y = 0; y < H; y++)
+    for (uint32_t x = 0; x < W; x++) {
+      uint8_t pixel;
+      BMP_L1_getPixel(bitmap.data(), x, y, &pixel);
+      if (canvas.get(x, y) != pixel) {
+        printf("Pixel (%u, %u) reads differently\n", (unsigned)x, (unsigned)y);
+        ret = -1;
+      }
+    }
+
+  BMP_L1_free(pbmpC);
+  return ret;
+}
+
+int main(void)
+{
+  if (test_bitmap<1, 1, false>() != 0 || test_bitmap<1, 1, true>() != 0
+      || test_bitmap<7, 3, false>() != 0 || test_bitmap<7, 3, true>() != 0
+      || test_bitmap<33, 5, false>() != 0 || test_bitmap<33, 5, true>() != 0
+      || test_bitmap<203, 17, false>() != 0 || test_bitmap<203, 17, true>() != 0)
+    return -1;
+  return 0;
+}